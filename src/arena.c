@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+// ---------------------------------------------------------------------------
+typedef union _arena_block_ {
+  // header in front of every block, keeps the payload aligned
+  struct {
+    size_t size_class;
+  } header;
+  char align[ARENA_ALIGN];
+} arena_block;
+
+// static region, usable before anything is resolved or mapped
+static char bootstrap[ARENA_BOOTSTRAP_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static size_t bootstrap_used = 0;
+
+// lazily mapped region, only touched pages are backed by memory
+static char* region = NULL;
+static size_t region_used = 0;
+
+// freed blocks, one list per power-of-two size class
+static void* free_list[ARENA_CLASSES];
+
+static char arena_lock = 0;
+
+// ---------------------------------------------------------------------------
+static void lock() {
+  while(__atomic_test_and_set(&arena_lock, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+// ---------------------------------------------------------------------------
+static void unlock() {
+  __atomic_clear(&arena_lock, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------
+static size_t class_size(size_t size_class) {
+  return (size_t) ARENA_ALIGN << size_class;
+}
+
+// ---------------------------------------------------------------------------
+static char* bump(size_t size) {
+  if(bootstrap_used + size <= ARENA_BOOTSTRAP_SIZE) {
+    char* block = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+    return block;
+  }
+  if(!region) {
+    void* m = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(m == MAP_FAILED)
+      return NULL;
+    __atomic_store_n(&region, (char*) m, __ATOMIC_RELEASE);
+  }
+  if(region_used + size <= ARENA_SIZE) {
+    char* block = region + region_used;
+    region_used += size;
+    return block;
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+void* arena_alloc(size_t size) {
+  if(size > ARENA_SIZE)
+    return NULL;
+  size_t size_class = 0;
+  while(size_class < ARENA_CLASSES && class_size(size_class) < size + sizeof(arena_block)) {
+    size_class++;
+  }
+  if(size_class == ARENA_CLASSES)
+    return NULL;
+
+  lock();
+  arena_block* block = (arena_block*) free_list[size_class];
+  if(block) {
+    free_list[size_class] = *(void**) (block + 1);
+  } else {
+    block = (arena_block*) bump(class_size(size_class));
+  }
+  unlock();
+
+  if(!block)
+    return NULL;
+  block->header.size_class = size_class;
+  return block + 1;
+}
+
+// ---------------------------------------------------------------------------
+void* arena_calloc(size_t elem, size_t size) {
+  if(size && elem > (size_t) -1 / size)
+    return NULL;
+  void* addr = arena_alloc(elem * size);
+  if(addr)
+    memset(addr, 0, elem * size);
+  return addr;
+}
+
+// ---------------------------------------------------------------------------
+void arena_free(void* addr) {
+  if(!addr)
+    return;
+  arena_block* block = ((arena_block*) addr) - 1;
+  size_t size_class = block->header.size_class;
+
+  lock();
+  *(void**) addr = free_list[size_class];
+  free_list[size_class] = block;
+  unlock();
+}
+
+// ---------------------------------------------------------------------------
+void* arena_realloc(void* addr, size_t size) {
+  if(!addr)
+    return arena_alloc(size);
+  if(!size) {
+    arena_free(addr);
+    return NULL;
+  }
+  size_t old_size = arena_size(addr);
+  if(size <= old_size)
+    return addr;
+  void* block = arena_alloc(size);
+  if(!block)
+    return NULL;
+  memcpy(block, addr, old_size);
+  arena_free(addr);
+  return block;
+}
+
+// ---------------------------------------------------------------------------
+size_t arena_size(const void* addr) {
+  const arena_block* block = ((const arena_block*) addr) - 1;
+  return class_size(block->header.size_class) - sizeof(arena_block);
+}
+
+// ---------------------------------------------------------------------------
+int arena_contains(const void* addr) {
+  uintptr_t a = (uintptr_t) addr;
+  if(a >= (uintptr_t) bootstrap && a < (uintptr_t) bootstrap + ARENA_BOOTSTRAP_SIZE)
+    return 1;
+  char* r = __atomic_load_n(&region, __ATOMIC_ACQUIRE);
+  return r && a >= (uintptr_t) r && a < (uintptr_t) r + ARENA_SIZE;
+}
@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_ARENA_H_
+#define SRC_ARENA_H_
+
+#include <stdlib.h>
+
+#define ARENA_BOOTSTRAP_SIZE (256 * 1024)
+#define ARENA_SIZE (64 * 1024 * 1024)
+#define ARENA_ALIGN 16
+#define ARENA_CLASSES 23
+
+void* arena_alloc(size_t size);
+void* arena_calloc(size_t elem, size_t size);
+void* arena_realloc(void* addr, size_t size);
+void arena_free(void* addr);
+size_t arena_size(const void* addr);
+int arena_contains(const void* addr);
+
+#endif /* SRC_ARENA_H_ */
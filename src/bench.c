@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define ITERATIONS 200000
+
+void* volatile sink;
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+void bench_malloc(int iterations) {
+  int i;
+  double start = now();
+  for(i = 0; i < iterations; i++) {
+    sink = malloc(16 + (i & 127));
+    free(sink);
+  }
+  printf("malloc/free: %.1f ns/call\n", (now() - start) / iterations);
+}
+
+void bench_free(int iterations) {
+  int i;
+  void** blocks = malloc(iterations * sizeof(void*));
+  if(!blocks)
+    return;
+  for(i = 0; i < iterations; i++) {
+    blocks[i] = malloc(16);
+  }
+  double start = now();
+  for(i = 0; i < iterations; i++) {
+    free(blocks[i]);
+  }
+  printf("free: %.1f ns/call\n", (now() - start) / iterations);
+  free(blocks);
+}
+
+void* malloc_worker(void* arg) {
+  int i, iterations = *(int*) arg;
+  for(i = 0; i < iterations; i++) {
+    void* p = malloc(16 + (i & 127));
+    free(p);
+  }
+  return NULL;
+}
+
+void bench_threads(int iterations, int max_threads) {
+  int t, i;
+  for(t = 1; t <= max_threads; t *= 2) {
+    pthread_t threads[t];
+    double start = now();
+    for(i = 0; i < t; i++) {
+      pthread_create(&threads[i], NULL, malloc_worker, &iterations);
+    }
+    for(i = 0; i < t; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    double elapsed = now() - start;
+    printf("%3d threads: %.2f Mcalls/s\n", t, (double) t * iterations / elapsed * 1e3);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = ITERATIONS;
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(argc > 1)
+    iterations = atoi(argv[1]);
+  if(argc > 2)
+    max_threads = atoi(argv[2]);
+
+  bench_malloc(iterations);
+  bench_free(iterations);
+  bench_threads(iterations, max_threads);
+  return 0;
+}
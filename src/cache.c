@@ -0,0 +1,338 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "elf_file.h"
+#include "cache.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// search path of the dynamic loader, without its cache
+static const char* library_paths_64[] = { "/lib/x86_64-linux-gnu", "/usr/lib/x86_64-linux-gnu", "/lib64",
+    "/usr/lib64", "/lib", "/usr/lib", "/usr/local/lib", NULL };
+static const char* library_paths_32[] = { "/lib/i386-linux-gnu", "/usr/lib/i386-linux-gnu", "/lib32", "/usr/lib32",
+    "/lib", "/usr/lib", "/usr/local/lib", NULL };
+
+// ---------------------------------------------------------------------------
+void cache_init(ResultCache* cache) {
+  memset(cache, 0, sizeof(ResultCache));
+  cache->hash = FNV_OFFSET;
+  cache->runs_fd = -1;
+}
+
+// ---------------------------------------------------------------------------
+void cache_add(ResultCache* cache, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*) data;
+  size_t i;
+  for(i = 0; i < size; i++) {
+    cache->hash = (cache->hash ^ bytes[i]) * FNV_PRIME;
+  }
+}
+
+// ---------------------------------------------------------------------------
+void cache_add_string(ResultCache* cache, const char* str) {
+  // including the terminator, so ("ab", "c") differs from ("a", "bc")
+  cache_add(cache, str, strlen(str) + 1);
+}
+
+// ---------------------------------------------------------------------------
+static int add_elf(ResultCache* cache, const char* path, ElfFile* elf) {
+  // the build id identifies the file, its content if there is none
+  char id[BUILD_ID_LENGTH];
+  if(get_build_id(path, id))
+    cache_add_string(cache, id);
+  else
+    cache_add(cache, elf->data, elf->size);
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+static int find_library(const char* name, int is_64, char* path, ElfFile* elf) {
+  if(strchr(name, '/')) {
+    snprintf(path, CACHE_PATH_LENGTH, "%s", name);
+    return elf_open(path, elf);
+  }
+
+  // LD_LIBRARY_PATH first, then the default directories
+  char directories[CACHE_PATH_LENGTH * 4];
+  const char* env = getenv("LD_LIBRARY_PATH");
+  snprintf(directories, sizeof(directories), "%s", env ? env : "");
+  char* save = NULL;
+  char* dir = strtok_r(directories, ":", &save);
+  const char** defaults = is_64 ? library_paths_64 : library_paths_32;
+  while(dir || *defaults) {
+    snprintf(path, CACHE_PATH_LENGTH, "%s/%s", dir ? dir : *defaults, name);
+    if(elf_open(path, elf)) {
+      // a library of the other class is skipped by the loader as well
+      if(elf->is_64 == is_64)
+        return 1;
+      elf_close(elf);
+    }
+    if(dir)
+      dir = strtok_r(NULL, ":", &save);
+    else
+      defaults++;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+void cache_add_binary(ResultCache* cache, const char* binary) {
+  ElfFile elf;
+  if(!elf_open(binary, &elf)) {
+    cache_add_string(cache, binary);
+    return;
+  }
+  add_elf(cache, binary, &elf);
+  int is_64 = elf.is_64;
+
+  // all libraries loaded with it, breadth first as the loader does
+  static char names[CACHE_MAX_LIBRARIES][CACHE_PATH_LENGTH];
+  int i, j, count = 0, current = -1;
+  while(1) {
+    const char* name;
+    int index = 0;
+    while((name = elf_get_needed(&elf, index++)) && count < CACHE_MAX_LIBRARIES) {
+      for(j = 0; j < count && strcmp(names[j], name); j++)
+        ;
+      if(j == count)
+        snprintf(names[count++], CACHE_PATH_LENGTH, "%s", name);
+    }
+    elf_close(&elf);
+
+    // next library which can be found, missing ones only add their name
+    char path[CACHE_PATH_LENGTH];
+    for(i = current + 1; i < count; i++) {
+      cache_add_string(cache, names[i]);
+      if(find_library(names[i], is_64, path, &elf)) {
+        add_elf(cache, path, &elf);
+        break;
+      }
+    }
+    if(i >= count)
+      break;
+    current = i;
+  }
+}
+
+// ---------------------------------------------------------------------------
+static void get_cache_file(ResultCache* cache, char* path, const char* name) {
+  snprintf(path, CACHE_PATH_LENGTH, "%s/%s", cache->directory, name);
+}
+
+// ---------------------------------------------------------------------------
+static int read_header(int fd, CacheHeader* header) {
+  return pread(fd, header, sizeof(CacheHeader), 0) == sizeof(CacheHeader) && header->magic == CACHE_MAGIC
+      && header->version == CACHE_VERSION;
+}
+
+// ---------------------------------------------------------------------------
+static int get_base_directory(const char* base, char* path) {
+  // the user's cache directory, shared by all working directories
+  const char* env = getenv(CACHE_DIRECTORY_ENV);
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  int length;
+  if(base && *base)
+    length = snprintf(path, CACHE_DIRECTORY_LENGTH, "%s", base);
+  else if(env && *env)
+    length = snprintf(path, CACHE_DIRECTORY_LENGTH, "%s", env);
+  else if(xdg && *xdg == '/')
+    length = snprintf(path, CACHE_DIRECTORY_LENGTH, "%s/%s", xdg, CACHE_DIRECTORY);
+  else if(home && *home)
+    length = snprintf(path, CACHE_DIRECTORY_LENGTH, "%s/.cache/%s", home, CACHE_DIRECTORY);
+  else
+    return 0;
+  return length > 0 && length < CACHE_DIRECTORY_LENGTH;
+}
+
+// ---------------------------------------------------------------------------
+static int make_directories(const char* directory) {
+  char path[CACHE_PATH_LENGTH];
+  snprintf(path, sizeof(path), "%s", directory);
+  char* slash = path;
+  while((slash = strchr(slash + 1, '/'))) {
+    *slash = 0;
+    if(mkdir(path, 0755) && errno != EEXIST)
+      return 0;
+    *slash = '/';
+  }
+  return !mkdir(path, 0755) || errno == EEXIST;
+}
+
+// ---------------------------------------------------------------------------
+int cache_open(ResultCache* cache, const char* base, int refresh) {
+  char path[CACHE_PATH_LENGTH];
+  if(!get_base_directory(base, cache->base))
+    return 0;
+  snprintf(cache->directory, sizeof(cache->directory), "%s/%016llx", cache->base, (unsigned long long) cache->hash);
+  if(!make_directories(cache->directory))
+    return 0;
+  map_initialize(cache->index, MAP_GENERAL);
+  cache->enabled = 1;
+
+  // everything stored before is dropped when refreshing
+  get_cache_file(cache, path, "runs");
+  if(refresh) {
+    unlink(path);
+    get_cache_file(cache, path, "profile");
+    unlink(path);
+    return 1;
+  }
+  cache->runs_fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+  CacheHeader header;
+  if(cache->runs_fd == -1 || !read_header(cache->runs_fd, &header)) {
+    if(cache->runs_fd != -1)
+      close(cache->runs_fd);
+    cache->runs_fd = -1;
+    return 1;
+  }
+  cache->profile_time = header.profile_time;
+  get_cache_file(cache, path, "profile");
+  cache->has_profile = !access(path, R_OK);
+
+  // a run interrupted while appending leaves an incomplete entry, it is cut
+  // off while no other campaign appends
+  struct stat st;
+  if(flock(cache->runs_fd, LOCK_EX))
+    return 1;
+  if(fstat(cache->runs_fd, &st)) {
+    flock(cache->runs_fd, LOCK_UN);
+    return 1;
+  }
+  size_t count = (st.st_size - sizeof(CacheHeader)) / sizeof(CachedRun);
+  cache->runs = (CachedRun*) malloc(count * sizeof(CachedRun) + 1);
+  ssize_t n = cache->runs ? pread(cache->runs_fd, cache->runs, count * sizeof(CachedRun), sizeof(CacheHeader)) : 0;
+  cache->run_count = n > 0 ? n / sizeof(CachedRun) : 0;
+  if(cache->run_count == count && ftruncate(cache->runs_fd, sizeof(CacheHeader) + count * sizeof(CachedRun))) {
+    close(cache->runs_fd);
+    cache->runs_fd = -1;
+  }
+  if(cache->runs_fd != -1)
+    flock(cache->runs_fd, LOCK_UN);
+  size_t i;
+  for(i = 0; i < cache->run_count; i++) {
+    map(cache->index)->set((void*) (size_t) cache->runs[i].key, &cache->runs[i]);
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int cache_open_profile(ResultCache* cache) {
+  if(!cache->enabled || !cache->has_profile)
+    return -1;
+  char path[CACHE_PATH_LENGTH];
+  get_cache_file(cache, path, "profile");
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// ---------------------------------------------------------------------------
+static int same_profile(ResultCache* cache, const void* profile, size_t size) {
+  // the runs stay valid if the profile did not change
+  int fd = cache_open_profile(cache);
+  if(fd == -1)
+    return 0;
+  char* data = (char*) malloc(size + 1);
+  int same = data && read(fd, data, size + 1) == (ssize_t) size && !memcmp(data, profile, size);
+  free(data);
+  close(fd);
+  return same;
+}
+
+// ---------------------------------------------------------------------------
+void cache_save_profile(ResultCache* cache, const void* profile, size_t size, double profile_time) {
+  if(!cache->enabled || same_profile(cache, profile, size))
+    return;
+  char path[CACHE_PATH_LENGTH], tmp[CACHE_PATH_LENGTH];
+
+  // written to a temporary file first, a concurrent campaign never sees half of it
+  get_cache_file(cache, tmp, "profile.tmp");
+  get_cache_file(cache, path, "profile");
+  FILE* f = fopen(tmp, "wb");
+  if(!f)
+    return;
+  int ok = fwrite(profile, 1, size, f) == size;
+  if(fclose(f) || !ok || rename(tmp, path)) {
+    unlink(tmp);
+    return;
+  }
+
+  // a new profile invalidates all runs of the old one
+  get_cache_file(cache, path, "runs");
+  if(cache->runs_fd != -1)
+    close(cache->runs_fd);
+  cache->runs_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, profile_time };
+  if(cache->runs_fd != -1 && write(cache->runs_fd, &header, sizeof(header)) != sizeof(header)) {
+    close(cache->runs_fd);
+    cache->runs_fd = -1;
+  }
+  map(cache->index)->clear();
+  cache->run_count = 0;
+  cache->profile_time = profile_time;
+  cache->has_profile = 1;
+}
+
+// ---------------------------------------------------------------------------
+const CachedRun* cache_find_run(ResultCache* cache, uint64_t key) {
+  if(!cache->enabled)
+    return NULL;
+  return (const CachedRun*) map(cache->index)->get((void*) (size_t) key);
+}
+
+// ---------------------------------------------------------------------------
+int cache_save_run(ResultCache* cache, uint64_t key, int status, const RunRecord* record) {
+  if(!cache->enabled || cache->runs_fd == -1)
+    return 0;
+  CachedRun run;
+  memset(&run, 0, sizeof(CachedRun));
+  run.key = key;
+  run.status = status;
+  run.record = *record;
+  // appended as a whole, concurrent campaigns do not interleave entries and
+  // the lock keeps cache_open from cutting it off
+  flock(cache->runs_fd, LOCK_SH);
+  int ok = write(cache->runs_fd, &run, sizeof(CachedRun)) == sizeof(CachedRun);
+  flock(cache->runs_fd, LOCK_UN);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+void cache_close(ResultCache* cache) {
+  if(cache->runs_fd != -1)
+    close(cache->runs_fd);
+  cache->runs_fd = -1;
+  if(cache->index)
+    map(cache->index)->destroy();
+  cache->index = NULL;
+  free(cache->runs);
+  cache->runs = NULL;
+  cache->enabled = 0;
+}
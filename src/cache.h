@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_CACHE_H_
+#define SRC_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "settings.h"
+#include "map.h"
+
+// results of earlier campaigns, one directory per key below --cache-dir,
+// $FAINT_CACHE_DIR, $XDG_CACHE_HOME/faint or ~/.cache/faint
+#define CACHE_DIRECTORY_ENV "FAINT_CACHE_DIR"
+#define CACHE_DIRECTORY "faint"
+#define CACHE_PATH_LENGTH 512
+#define CACHE_DIRECTORY_LENGTH 384
+#define CACHE_MAGIC 0x48434146
+#define CACHE_VERSION 3
+#define CACHE_MAX_LIBRARIES 256
+
+// start of the runs file, the profile is stored next to it
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  double profile_time;
+} CacheHeader;
+
+// outcome of one injection run, appended once the run is reported
+typedef struct {
+  uint64_t key;
+  int32_t status;
+  int32_t reserved;
+  RunRecord record;
+} CachedRun;
+
+typedef struct {
+  uint64_t hash;
+  int enabled;
+  int has_profile;
+  double profile_time;
+  char base[CACHE_DIRECTORY_LENGTH];
+  // the base with the key appended
+  char directory[CACHE_DIRECTORY_LENGTH + 32];
+  int runs_fd;
+  CachedRun* runs;
+  size_t run_count;
+  cmap* index;
+} ResultCache;
+
+void cache_init(ResultCache* cache);
+void cache_add(ResultCache* cache, const void* data, size_t size);
+void cache_add_string(ResultCache* cache, const char* str);
+void cache_add_binary(ResultCache* cache, const char* binary);
+int cache_open(ResultCache* cache, const char* base, int refresh);
+int cache_open_profile(ResultCache* cache);
+void cache_save_profile(ResultCache* cache, const void* profile, size_t size, double profile_time);
+const CachedRun* cache_find_run(ResultCache* cache, uint64_t key);
+int cache_save_run(ResultCache* cache, uint64_t key, int status, const RunRecord* record);
+void cache_close(ResultCache* cache);
+
+#endif /* SRC_CACHE_H_ */
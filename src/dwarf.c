@@ -0,0 +1,382 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "dwarf.h"
+
+// opcodes of the line number program, DWARF 2 to 5
+#define DW_LNS_copy 1
+#define DW_LNS_advance_pc 2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file 4
+#define DW_LNS_const_add_pc 8
+#define DW_LNS_fixed_advance_pc 9
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address 2
+#define DW_LNE_define_file 3
+
+// entry formats of DWARF 5 directory and file tables
+#define DW_LNCT_path 1
+#define DW_FORM_block 0x09
+#define DW_FORM_block1 0x0a
+#define DW_FORM_data1 0x0b
+#define DW_FORM_data2 0x05
+#define DW_FORM_data4 0x06
+#define DW_FORM_data8 0x07
+#define DW_FORM_data16 0x1e
+#define DW_FORM_string 0x08
+#define DW_FORM_strp 0x0e
+#define DW_FORM_line_strp 0x1f
+#define DW_FORM_udata 0x0f
+#define DW_FORM_sdata 0x0d
+
+// a bounds-checked view of a section
+typedef struct {
+  const uint8_t* data;
+  const uint8_t* end;
+  int error;
+} Reader;
+
+typedef struct {
+  Reader strings;
+  Reader line_strings;
+  LineRow* rows;
+  size_t count;
+  size_t size;
+} LineTable;
+
+// ---------------------------------------------------------------------------
+static uint64_t read_bytes(Reader* r, uint64_t size) {
+  // lengths come from the file, a huge one must not wrap around
+  if((uint64_t) (r->end - r->data) < size) {
+    r->error = 1;
+    r->data = r->end;
+    return 0;
+  }
+  // ELF files are read on a host of the same byte order only
+  uint64_t value = 0;
+  memcpy(&value, r->data, size < sizeof(value) ? size : sizeof(value));
+  r->data += size;
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+static uint64_t read_uleb(Reader* r) {
+  uint64_t value = 0;
+  int shift = 0;
+  while(r->data < r->end) {
+    uint8_t byte = *r->data++;
+    if(shift < 64)
+      value |= (uint64_t) (byte & 0x7f) << shift;
+    shift += 7;
+    if(!(byte & 0x80))
+      return value;
+  }
+  r->error = 1;
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+static int64_t read_sleb(Reader* r) {
+  int64_t value = 0;
+  int shift = 0;
+  while(r->data < r->end) {
+    uint8_t byte = *r->data++;
+    if(shift < 64)
+      value |= (int64_t) (byte & 0x7f) << shift;
+    shift += 7;
+    if(!(byte & 0x80)) {
+      if(shift < 64 && (byte & 0x40))
+        value |= -((int64_t) 1 << shift);
+      return value;
+    }
+  }
+  r->error = 1;
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+static const char* read_string(Reader* r) {
+  const char* s = (const char*) r->data;
+  const uint8_t* end = memchr(r->data, 0, r->end - r->data);
+  if(!end) {
+    r->error = 1;
+    r->data = r->end;
+    return "";
+  }
+  r->data = end + 1;
+  return s;
+}
+
+// ---------------------------------------------------------------------------
+static const char* string_at(const Reader* strings, uint64_t offset) {
+  if(offset >= strings->end - strings->data || !memchr(strings->data + offset, 0, strings->end - strings->data - offset))
+    return "";
+  return (const char*) strings->data + offset;
+}
+
+// ---------------------------------------------------------------------------
+static const char* base_name(const char* path) {
+  // like addr2line -s, files are shown without their directory
+  const char* name = strrchr(path, '/');
+  return name ? name + 1 : path;
+}
+
+// ---------------------------------------------------------------------------
+static int add_row(LineTable* table, uint64_t address, const char* file, uint32_t line, int end) {
+  if(table->count == table->size) {
+    size_t size = table->size ? table->size * 2 : 1024;
+    LineRow* rows = realloc(table->rows, size * sizeof(LineRow));
+    if(!rows)
+      return 0;
+    table->rows = rows;
+    table->size = size;
+  }
+  LineRow* row = &table->rows[table->count++];
+  row->address = address;
+  row->file = file;
+  row->line = line;
+  row->end = end;
+  row->order = table->count;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+static int read_entry_table(Reader* r, LineTable* table, int offset_size, const char*** names, uint64_t* count) {
+  // DWARF 5: a description of the columns, followed by the entries
+  uint8_t format_count = read_bytes(r, 1);
+  uint64_t formats[2 * 255];
+  uint64_t i, j;
+  for(i = 0; i < format_count; i++) {
+    formats[2 * i] = read_uleb(r);
+    formats[2 * i + 1] = read_uleb(r);
+  }
+  *count = read_uleb(r);
+  if(r->error || *count > (uint64_t) (r->end - r->data))
+    return 0;
+  *names = calloc(*count ? *count : 1, sizeof(char*));
+  if(!*names)
+    return 0;
+
+  for(i = 0; i < *count && !r->error; i++) {
+    (*names)[i] = "";
+    for(j = 0; j < format_count; j++) {
+      const char* name = NULL;
+      switch(formats[2 * j + 1]) {
+        case DW_FORM_string: name = read_string(r); break;
+        case DW_FORM_strp: name = string_at(&table->strings, read_bytes(r, offset_size)); break;
+        case DW_FORM_line_strp: name = string_at(&table->line_strings, read_bytes(r, offset_size)); break;
+        case DW_FORM_data1: read_bytes(r, 1); break;
+        case DW_FORM_data2: read_bytes(r, 2); break;
+        case DW_FORM_data4: read_bytes(r, 4); break;
+        case DW_FORM_data8: read_bytes(r, 8); break;
+        case DW_FORM_data16: read_bytes(r, 16); break;
+        case DW_FORM_udata: read_uleb(r); break;
+        case DW_FORM_sdata: read_sleb(r); break;
+        case DW_FORM_block: read_bytes(r, read_uleb(r)); break;
+        case DW_FORM_block1: read_bytes(r, read_bytes(r, 1)); break;
+        default: r->error = 1; break;
+      }
+      if(name && formats[2 * j] == DW_LNCT_path)
+        (*names)[i] = name;
+    }
+  }
+  return !r->error;
+}
+
+// ---------------------------------------------------------------------------
+static int parse_unit(Reader* unit, LineTable* table, int offset_size, uint16_t version) {
+  Reader* r = unit;
+  if(version >= 5) {
+    // address and segment selector size
+    read_bytes(r, 2);
+  }
+  uint64_t header_length = read_bytes(r, offset_size);
+  if(r->error || header_length > (uint64_t) (r->end - r->data))
+    return 0;
+  const uint8_t* program = r->data + header_length;
+
+  uint8_t min_length = read_bytes(r, 1);
+  if(version >= 4)
+    read_bytes(r, 1);
+  read_bytes(r, 1);
+  int8_t line_base = (int8_t) read_bytes(r, 1);
+  uint8_t line_range = read_bytes(r, 1);
+  uint8_t opcode_base = read_bytes(r, 1);
+  uint8_t lengths[256] = { 0 };
+  int i;
+  for(i = 1; i < opcode_base; i++) {
+    lengths[i] = read_bytes(r, 1);
+  }
+  if(r->error || !line_range)
+    return 0;
+
+  // file names, DWARF 5 counts them from 0, older versions from 1
+  const char** files = NULL;
+  uint64_t file_count = 0, first_file = (version >= 5) ? 0 : 1;
+  if(version >= 5) {
+    const char** directories = NULL;
+    uint64_t directory_count;
+    int ok = read_entry_table(r, table, offset_size, &directories, &directory_count);
+    free(directories);
+    if(!ok || !read_entry_table(r, table, offset_size, &files, &file_count)) {
+      free(files);
+      return 0;
+    }
+  } else {
+    while(r->data < r->end && *r->data)
+      read_string(r);
+    read_bytes(r, 1);
+    size_t size = 0;
+    while(r->data < r->end && *r->data && !r->error) {
+      if(file_count == size) {
+        size = size ? size * 2 : 16;
+        const char** more = realloc(files, size * sizeof(char*));
+        if(!more) {
+          free(files);
+          return 0;
+        }
+        files = more;
+      }
+      files[file_count++] = read_string(r);
+      read_uleb(r);
+      read_uleb(r);
+      read_uleb(r);
+    }
+  }
+  for(i = 0; i < file_count; i++) {
+    files[i] = base_name(files[i]);
+  }
+
+  // run the line number program
+  r->data = program;
+  r->error = 0;
+  uint64_t address = 0, file = 1;
+  int64_t line = 1;
+  int ok = 1;
+#define CURRENT_FILE ((file - first_file) < file_count ? files[file - first_file] : "??")
+  while(r->data < r->end && !r->error && ok) {
+    uint8_t opcode = read_bytes(r, 1);
+    if(opcode >= opcode_base) {
+      // special opcode: advance address and line, add a row
+      int adjusted = opcode - opcode_base;
+      address += (adjusted / line_range) * min_length;
+      line += line_base + adjusted % line_range;
+      ok = add_row(table, address, CURRENT_FILE, line, 0);
+    } else if(opcode == 0) {
+      uint64_t length = read_uleb(r);
+      if(!length || length > (uint64_t) (r->end - r->data))
+        break;
+      const uint8_t* next = r->data + length;
+      uint8_t sub = read_bytes(r, 1);
+      if(sub == DW_LNE_end_sequence) {
+        ok = add_row(table, address, CURRENT_FILE, line, 1);
+        address = 0;
+        file = 1;
+        line = 1;
+      } else if(sub == DW_LNE_set_address && length - 1 <= 8) {
+        address = read_bytes(r, length - 1);
+      }
+      r->data = next;
+    } else if(opcode == DW_LNS_copy) {
+      ok = add_row(table, address, CURRENT_FILE, line, 0);
+    } else if(opcode == DW_LNS_advance_pc) {
+      address += read_uleb(r) * min_length;
+    } else if(opcode == DW_LNS_advance_line) {
+      line += read_sleb(r);
+    } else if(opcode == DW_LNS_set_file) {
+      file = read_uleb(r);
+    } else if(opcode == DW_LNS_const_add_pc) {
+      address += ((255 - opcode_base) / line_range) * min_length;
+    } else if(opcode == DW_LNS_fixed_advance_pc) {
+      address += read_bytes(r, 2);
+    } else {
+      // everything else only changes columns and flags
+      for(i = 0; i < lengths[opcode]; i++) {
+        read_uleb(r);
+      }
+    }
+  }
+#undef CURRENT_FILE
+  free(files);
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+static int compare_rows(const void* a, const void* b) {
+  const LineRow* ra = a;
+  const LineRow* rb = b;
+  if(ra->address != rb->address)
+    return ra->address < rb->address ? -1 : 1;
+  // a sequence starting where another one ends wins
+  if(ra->end != rb->end)
+    return ra->end ? -1 : 1;
+  // otherwise keep the order of the line program
+  return ra->order < rb->order ? -1 : (ra->order > rb->order);
+}
+
+// ---------------------------------------------------------------------------
+int parse_line_table(const ElfFile* elf, LineRow** rows, size_t* count) {
+  ElfSection lines, section;
+  *rows = NULL;
+  *count = 0;
+  if(!elf_find_section(elf, ".debug_line", &lines) || lines.type == SHT_NOBITS)
+    return 0;
+
+  LineTable table;
+  memset(&table, 0, sizeof(table));
+  if(elf_find_section(elf, ".debug_str", &section) && section.type != SHT_NOBITS) {
+    table.strings.data = elf->data + section.offset;
+    table.strings.end = table.strings.data + section.size;
+  }
+  if(elf_find_section(elf, ".debug_line_str", &section) && section.type != SHT_NOBITS) {
+    table.line_strings.data = elf->data + section.offset;
+    table.line_strings.end = table.line_strings.data + section.size;
+  }
+
+  Reader r = { elf->data + lines.offset, elf->data + lines.offset + lines.size, 0 };
+  while(r.data < r.end && !r.error) {
+    // 32 or 64 bit DWARF, the length says which
+    int offset_size = 4;
+    uint64_t length = read_bytes(&r, 4);
+    if(length == 0xffffffff) {
+      offset_size = 8;
+      length = read_bytes(&r, 8);
+    }
+    if(r.error || length > (uint64_t) (r.end - r.data))
+      break;
+    Reader unit = { r.data, r.data + length, 0 };
+    r.data += length;
+    uint16_t version = read_bytes(&unit, 2);
+    // units we do not understand are skipped, the others are still used
+    if(version >= 2 && version <= 5)
+      parse_unit(&unit, &table, offset_size, version);
+  }
+
+  // sorted by address, an address belongs to the last row before it
+  qsort(table.rows, table.count, sizeof(LineRow), compare_rows);
+  *rows = table.rows;
+  *count = table.count;
+  return table.count > 0;
+}
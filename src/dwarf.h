@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_DWARF_H_
+#define SRC_DWARF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "elf_file.h"
+
+// one row of the line table, rows marked as end close their sequence
+typedef struct {
+  uint64_t address;
+  const char* file;
+  uint32_t line;
+  uint32_t end;
+  uint64_t order;
+} LineRow;
+
+int parse_line_table(const ElfFile* elf, LineRow** rows, size_t* count);
+
+#endif /* SRC_DWARF_H_ */
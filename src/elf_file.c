@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "elf_file.h"
+
+// ---------------------------------------------------------------------------
+int elf_open(const char* binary, ElfFile* elf) {
+  memset(elf, 0, sizeof(ElfFile));
+  int fd = open(binary, O_RDONLY | O_CLOEXEC);
+  if(fd == -1)
+    return 0;
+  struct stat st;
+  if(fstat(fd, &st) || st.st_size < (off_t) sizeof(Elf32_Ehdr)) {
+    close(fd);
+    return 0;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return 0;
+  elf->data = data;
+  elf->size = st.st_size;
+
+  const unsigned char* ident = elf->data;
+  if(memcmp(ident, ELFMAG, SELFMAG) || (ident[EI_CLASS] != ELFCLASS32 && ident[EI_CLASS] != ELFCLASS64)
+      || (ident[EI_CLASS] == ELFCLASS64 && elf->size < sizeof(Elf64_Ehdr))) {
+    elf_close(elf);
+    return 0;
+  }
+  elf->is_64 = (ident[EI_CLASS] == ELFCLASS64);
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void elf_close(ElfFile* elf) {
+  if(elf->data)
+    munmap((void*) elf->data, elf->size);
+  elf->data = NULL;
+}
+
+// ---------------------------------------------------------------------------
+int elf_section_count(const ElfFile* elf) {
+  uint64_t offset = elf->is_64 ? ((const Elf64_Ehdr*) elf->data)->e_shoff : ((const Elf32_Ehdr*) elf->data)->e_shoff;
+  int count = elf->is_64 ? ((const Elf64_Ehdr*) elf->data)->e_shnum : ((const Elf32_Ehdr*) elf->data)->e_shnum;
+  size_t size = elf->is_64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+  // the section headers have to be inside of the file
+  if(!offset || offset > elf->size || (elf->size - offset) / size < count)
+    return 0;
+  return count;
+}
+
+// ---------------------------------------------------------------------------
+static int read_section(const ElfFile* elf, int index, ElfSection* section) {
+  if(index < 0 || index >= elf_section_count(elf))
+    return 0;
+  if(elf->is_64) {
+    const Elf64_Ehdr* header = (const Elf64_Ehdr*) elf->data;
+    const Elf64_Shdr* s = (const Elf64_Shdr*) (elf->data + header->e_shoff) + index;
+    section->type = s->sh_type;
+    section->address = s->sh_addr;
+    section->offset = s->sh_offset;
+    section->size = s->sh_size;
+    section->link = s->sh_link;
+    section->entry_size = s->sh_entsize;
+    section->name = (const char*) (uintptr_t) s->sh_name;
+  } else {
+    const Elf32_Ehdr* header = (const Elf32_Ehdr*) elf->data;
+    const Elf32_Shdr* s = (const Elf32_Shdr*) (elf->data + header->e_shoff) + index;
+    section->type = s->sh_type;
+    section->address = s->sh_addr;
+    section->offset = s->sh_offset;
+    section->size = s->sh_size;
+    section->link = s->sh_link;
+    section->entry_size = s->sh_entsize;
+    section->name = (const char*) (uintptr_t) s->sh_name;
+  }
+  // sections without data in the file have no size we could read
+  if(section->type != SHT_NOBITS && (section->offset > elf->size || section->size > elf->size - section->offset))
+    return 0;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int elf_get_section(const ElfFile* elf, int index, ElfSection* section) {
+  if(!read_section(elf, index, section))
+    return 0;
+  // the name is an offset into the section name table
+  size_t name = (size_t) (uintptr_t) section->name;
+  int strings = elf->is_64 ? ((const Elf64_Ehdr*) elf->data)->e_shstrndx : ((const Elf32_Ehdr*) elf->data)->e_shstrndx;
+  ElfSection table;
+  if(!read_section(elf, strings, &table) || name >= table.size
+      || !memchr(elf->data + table.offset + name, 0, table.size - name)) {
+    section->name = "";
+    return 1;
+  }
+  section->name = (const char*) elf->data + table.offset + name;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int elf_find_section(const ElfFile* elf, const char* name, ElfSection* section) {
+  int i, count = elf_section_count(elf);
+  for(i = 0; i < count; i++) {
+    if(elf_get_section(elf, i, section) && !strcmp(section->name, name))
+      return 1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+const char* elf_get_needed(const ElfFile* elf, int index) {
+  // libraries the binary depends on, in the order of the dynamic section
+  ElfSection dynamic, strings;
+  if(!elf_find_section(elf, ".dynamic", &dynamic) || dynamic.type == SHT_NOBITS)
+    return NULL;
+  if(!elf_get_section(elf, dynamic.link, &strings) || strings.type == SHT_NOBITS)
+    return NULL;
+
+  size_t entry_size = elf->is_64 ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+  size_t i, count = dynamic.size / entry_size;
+  const uint8_t* data = elf->data + dynamic.offset;
+  for(i = 0; i < count; i++) {
+    int64_t tag;
+    uint64_t value;
+    if(elf->is_64) {
+      tag = ((const Elf64_Dyn*) data)[i].d_tag;
+      value = ((const Elf64_Dyn*) data)[i].d_un.d_val;
+    } else {
+      tag = ((const Elf32_Dyn*) data)[i].d_tag;
+      value = ((const Elf32_Dyn*) data)[i].d_un.d_val;
+    }
+    if(tag == DT_NULL)
+      break;
+    if(tag != DT_NEEDED)
+      continue;
+    if(index-- == 0)
+      return value < strings.size ? (const char*) elf->data + strings.offset + value : NULL;
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+int get_build_id(const char* binary, char* id) {
+  ElfFile elf;
+  if(!elf_open(binary, &elf))
+    return 0;
+
+  // the build id is a note of the linker, usually in .note.gnu.build-id
+  int i, found = 0, count = elf_section_count(&elf);
+  for(i = 0; i < count && !found; i++) {
+    ElfSection section;
+    if(!elf_get_section(&elf, i, &section) || section.type != SHT_NOTE)
+      continue;
+    // notes have the same layout in 32 and 64 bit files
+    const uint8_t* note = elf.data + section.offset;
+    const uint8_t* end = note + section.size;
+    while(note + sizeof(Elf32_Nhdr) <= end) {
+      const Elf32_Nhdr* header = (const Elf32_Nhdr*) note;
+      size_t name_size = (header->n_namesz + 3) & ~3, desc_size = (header->n_descsz + 3) & ~3;
+      const uint8_t* desc = note + sizeof(Elf32_Nhdr) + name_size;
+      if(desc + desc_size > end)
+        break;
+      if(header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && !memcmp(note + sizeof(Elf32_Nhdr), "GNU", 4)
+          && header->n_descsz > 0 && header->n_descsz * 2 < BUILD_ID_LENGTH) {
+        uint32_t j;
+        for(j = 0; j < header->n_descsz; j++) {
+          sprintf(id + j * 2, "%02x", desc[j]);
+        }
+        found = 1;
+        break;
+      }
+      note = desc + desc_size;
+    }
+  }
+  elf_close(&elf);
+  return found;
+}
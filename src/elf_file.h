@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_ELF_FILE_H_
+#define SRC_ELF_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a binary mapped read-only, 32 and 64 bit files are handled alike
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  int is_64;
+} ElfFile;
+
+// section header, independent of the class of the file
+typedef struct {
+  const char* name;
+  uint32_t type;
+  uint64_t address;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint64_t entry_size;
+} ElfSection;
+
+#define BUILD_ID_LENGTH 64
+
+int elf_open(const char* binary, ElfFile* elf);
+void elf_close(ElfFile* elf);
+int elf_section_count(const ElfFile* elf);
+int elf_get_section(const ElfFile* elf, int index, ElfSection* section);
+int elf_find_section(const ElfFile* elf, const char* name, ElfSection* section);
+const char* elf_get_needed(const ElfFile* elf, int index);
+int get_build_id(const char* binary, char* id);
+
+#endif /* SRC_ELF_FILE_H_ */
@@ -29,18 +29,55 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include "settings.h"
 #include "map.h"
 #include "usage.h"
 #include "log.h"
 #include "modules.h"
 #include "utils.h"
+#include "supervisor.h"
+#include "symbolizer.h"
+#include "cache.h"
+#include "profile.h"
+#include "trace.h"
 #include "faint.h"
 
 static FaultSettings settings;
 static int valgrind = 0;
 static int profile_only = 0;
 static int inject_only = 0;
+static int jobs = 0;
+static int fork_server = 0;
+static int explore = 0;
+static double timeout = -1;
+static int keep_aslr = 0;
+// crashes are grouped by this many innermost frames
+static int bucket_depth = 1;
+static int no_cache = 0;
+static int refresh_cache = 0;
+static const char* cache_directory = NULL;
+static ResultCache cache;
+// ordered trace of the calls of the profiling run
+static const char* trace_calls = NULL;
+static const char* show_call_trace = NULL;
+
+// shared with every run, see settings.h
+static ControlBlock* control = NULL;
+static int control_fd = -1;
+
+// output of all runs forked by the exploration, and where each one is
+static int exploration_output = -1;
+static RunOutput* explored_output = NULL;
+
+// points to the extracted fault inject library
+static char preload_env[64];
 
 #ifndef VERSION
 #define VERSION "0.1-debug"
@@ -54,15 +91,20 @@ int main(int argc, char* argv[]) {
   }
   // modules enabled by default
   enable_default_modules();
+  // injection sites are identified by the calling frame only
+  settings.stack_depth = 1;
+  create_control_block();
 
   // parse commandline
   int binary_pos = parse_commandline(argc, argv);
+  if(show_call_trace)
+    return !show_trace(show_call_trace, binary_pos ? argv[binary_pos] : NULL);
+  if(!jobs)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
 
   atexit(cleanup);
   log("Starting, Version %s\n", VERSION);
 
-  // preload fault inject library
-  char* const envs[] = { (char*) "LD_PRELOAD=./fault_inject.so", NULL };
   char* args[argc + 1];
 
   // inherit all arguments
@@ -96,47 +138,74 @@ int main(int argc, char* argv[]) {
   // extract fault inject library
   extract_shared_library(arch);
 
-  // disable aslr to always get correct debug infos over multiple injection runs
-  disable_aslr();
-
-  // fork first to profile
-  if(!inject_only) {
+  // results are reused as long as nothing which influences a run changed
+  cache_init(&cache);
+  if(!no_cache)
+    open_result_cache(argv + binary_pos, argc - binary_pos, arch);
+
+  // sites do not depend on the load address, but runs of the target behave
+  // more alike without aslr
+  if(!keep_aslr)
+    disable_aslr();
+
+  // fork first to profile, unless the profile is cached or the calls traced
+  int profile_fd = inject_only || trace_calls ? -1 : cache_open_profile(&cache), heap_fd = -1, calls_fd = -1;
+  int profiling = !inject_only && profile_fd == -1;
+  double profile_time = cache.profile_time;
+  if(profiling) {
     log("{green}Profiling start{/green}");
-    FILE* f = fopen("profile", "wb");
-    if(!f) {
-      log("{red}Need write access to file 'profile'!{/red}");
-      exit(1);
+    if(profile_only) {
+      FILE* f = fopen("profile", "wb");
+      if(!f) {
+        log("{red}Need write access to file 'profile'!{/red}");
+        exit(1);
+      }
+      fclose(f);
     }
-    fclose(f);
+    // the profile is only kept in memory, unless it is needed later
+    profile_fd = create_memory_file("faint-profile");
+    if(settings.trace_heap)
+      heap_fd = create_memory_file("faint-heap");
+    if(trace_calls)
+      calls_fd = create_trace_file(trace_calls);
+  } else if(!inject_only) {
+    log("{green}Using cached profile{/green}");
+    if(timeout < 0)
+      timeout = profile_time * TIMEOUT_FACTOR + TIMEOUT_SLACK;
   } else {
     // inject only needs already a profile
-    FILE* f = fopen("profile", "rb");
-    if(!f) {
+    if(trace_calls)
+      log("{red}Calls are only traced while profiling, --trace-calls is ignored{/red}");
+    profile_fd = open("profile", O_RDONLY);
+    if(profile_fd == -1) {
       log("{red}Need file 'profile'! Start with --profile-only first.{/red}");
       exit(1);
     }
-    fclose(f);
   }
 
-  map_create(crashes, MAP_GENERAL);
-  map_create(types, MAP_GENERAL);
-  int crash_count = 0;
+  map_create(crashes, MAP_STRING);
+  ProfileFile sites;
+  int results[RUN_RESULTS] = { 0 };
   int injections = 0;
-  size_t *fault_addr, *fault_count, *fault_type;
+  const ProfileEntry* profile = NULL;
   size_t calls = 0;
-  size_t app_base = 0;
 
   pid_t pid;
   // fork only if profiling is needed
-  if(!inject_only) {
+  if(profiling) {
+    set_mode(PROFILE);
     pid = fork();
   } else {
     pid = 1;
   }
   if(pid) {
-    if(!inject_only) {
+    if(profiling) {
       int status;
-      waitpid(pid, &status, 0);
+      double start = get_time();
+      if(wait_supervised(pid, timeout > 0 ? timeout : 0, &status) > 0) {
+        log("{red}Profiling timed out after %.1f s, aborting now{/red}", timeout);
+        exit(1);
+      }
       if(!WIFEXITED(status)) {
         log("{red}There was an error while profiling, aborting now{/red}");
         show_return_details(status);
@@ -144,114 +213,96 @@ int main(int argc, char* argv[]) {
       }
 
       log("{green}Profiling done{/green}");
+      // injection runs should not take much longer than the profiling run
+      profile_time = get_time() - start;
+      if(timeout < 0)
+        timeout = profile_time * TIMEOUT_FACTOR + TIMEOUT_SLACK;
       // profiling done, fork to inject
     }
 
-    injections = parse_profiling(&fault_addr, &fault_count, &fault_type, &calls, types);
-    if(settings.trace_heap)
-      show_heap();
+    injections = parse_profiling(profile_fd, !profiling, &sites, &calls);
+    profile = sites.sites;
+    close(profile_fd);
+    if(settings.trace_heap) {
+      show_heap(heap_fd);
+      close(heap_fd);
+    }
+    if(calls_fd != -1) {
+      log("Call trace written to '%s'", trace_calls);
+      close(calls_fd);
+    }
+    if(profile_only)
+      save_profile(&sites);
+    cache_save_profile(&cache, sites.data, sites.size, profile_time);
 
     log("Found %d different injection positions with %d call(s)", injections, calls);
 
     for(i = 0; i < injections; i++) {
-      print_fault_position(get_filename(), (void*) (fault_addr[i]), fault_type[i], fault_count[i]);
+      print_fault_position(get_filename(), &profile[i], profile[i].count);
     }
     log("");
 
     if(!profile_only) {
       // let one specific function fail per loop iteration
       log("Injecting %d faults, one for every injection position", injections);
-
-      app_base = get_base_address();
-      log("Application base: 0x%zx", app_base);
-      for(i = 0; i < injections; i++) {
-        pid = fork();
-        if(pid) {
-          int killed = wait_for_child(pid);
-
-          void *crash, *fault;
-          int has_addr = get_crash_address(&crash, &fault);
-          if(has_addr) {
-              crash_details(get_filename(), crash, fault, types, app_base);
-            map(crashes)->set(crash, fault);
-            crash_count++;
-          } else {
-            if(killed)
-              crash_count++;
-          }
-
-          if(settings.trace_heap)
-            show_heap();
-          log("{green}Injection #%d done{/green}", (i + 1));
-        } else {
-          log("\n\n{green}Inject fault #%d{/green}", (i + 1));
-          log("Fault position:");
-          print_fault_position(get_filename(), (void*) (fault_addr[i]), fault_type[i], -1);
-          log("");
-
-          // -> inject
-          clear_crash_report();
-          set_mode(INJECT);
-          set_limit(i);
-          execve(args[0], args, envs);
-          log("Could not execute %s", get_filename());
-          exit(0);
-        }
-      }
+      arm_sites(profile, injections);
+
+      if(jobs > 1)
+        log("Running %d injections in parallel", jobs);
+      if(timeout > 0)
+        log("Timeout per run: %.1f s", timeout);
+      int cached = restore_cached_runs(profile, injections);
+      if(cached)
+        log("Reusing %d cached result(s), %d injection(s) left", cached, injections - cached);
+      if(explore && cached < injections)
+        explore_injections(args, injections);
+      run_injections(args, profile, injections, crashes, &sites, results);
     }
-    free(fault_addr);
-    free(fault_count);
-    free(fault_type);
   } else {
     // -> profile
-    set_mode(PROFILE);
-
+    setup_child();
+    char control_env[32], profile_env[32], heap_env[32], calls_env[32];
+    get_fd_env(control_env, CONTROL_ENV, control_fd);
+    get_fd_env(profile_env, PROFILE_ENV, inherit_fd(profile_fd));
+    get_fd_env(heap_env, HEAP_ENV, inherit_fd(heap_fd));
+    get_fd_env(calls_env, CALLS_ENV, inherit_fd(calls_fd));
+    char* const envs[] = { preload_env, control_env, profile_env, heap_env, calls_env, NULL };
     execve(args[0], args, envs);
     log("{red}Could not execute %s{/red}", get_filename());
   }
 
   if(!profile_only)
-    summary(get_filename(), crash_count, injections, crashes, types, app_base);
+    summary(get_filename(), results, injections, crashes, &sites);
 
-  map(crashes)->destroy();
-  map(types)->destroy();
+  destroy_crashes(crashes);
+  profile_close(&sites);
+  cache_close(&cache);
   return 0;
 }
 
 // ---------------------------------------------------------------------------
 void extract_shared_library(int arch) {
-  size_t fault_lib_size;
-  if(arch == ARCH_32) {
-    fault_lib_size = (size_t) ((char*) fault_lib32_end - (char*) fault_lib32);
-  } else {
-    fault_lib_size = (size_t) ((char*) fault_lib_end - (char*) fault_lib);
-  }
-
-  FILE* so = fopen("./fault_inject.so", "rb");
-  if(so) {
-    // file already extracted, done
-    fclose(so);
-    return;
-  }
-
-  so = fopen("./fault_inject.so", "wb");
-  if(!so) {
+  const char* lib = (const char*) (arch == ARCH_32 ? fault_lib32 : fault_lib);
+  size_t size = arch == ARCH_32 ? (size_t) ((char*) fault_lib32_end - (char*) fault_lib32)
+      : (size_t) ((char*) fault_lib_end - (char*) fault_lib);
+
+  // the library only lives in memory, every run inherits the file and loads
+  // it through its own file descriptor table
+  int fd = memfd_create("fault_inject.so", 0);
+  if(fd == -1) {
     log("{red}Could not extract 'fault_inject.so'. Aborting.{/red}");
     exit(1);
   }
-
-  int write_ret;
-  if(arch == ARCH_32) {
-    write_ret = fwrite(fault_lib32, fault_lib_size, 1, so);
-  } else {
-    write_ret = fwrite(fault_lib, fault_lib_size, 1, so);
-  }
-  if(write_ret != 1) {
-    log("{red}Could not write to file 'fault_inject.so'. Aborting.{/red}");
-    fclose(so);
-    exit(1);
+  size_t done = 0;
+  while(done < size) {
+    ssize_t n = write(fd, lib + done, size - done);
+    if(n <= 0) {
+      log("{red}Could not write to file 'fault_inject.so'. Aborting.{/red}");
+      exit(1);
+    }
+    done += n;
   }
-  fclose(so);
+  snprintf(preload_env, sizeof(preload_env), "LD_PRELOAD=/proc/self/fd/%d", fd);
 }
 
 // ---------------------------------------------------------------------------
@@ -263,11 +314,81 @@ void usage(const char* binary) {
 
 // ---------------------------------------------------------------------------
 void write_settings() {
-  FILE* f = fopen("settings", "wb");
-  if(f) {
-    fwrite(&settings, sizeof(FaultSettings), 1, f);
-    fclose(f);
+  // runs copy the settings when they start
+  control->settings = settings;
+}
+
+// ---------------------------------------------------------------------------
+void create_control_block() {
+  control_fd = memfd_create("faint-control", 0);
+  if(control_fd == -1) {
+    log("{red}Could not create the control block, aborting now{/red}");
+    exit(1);
+  }
+  resize_control_block(0);
+  control->magic = CONTROL_MAGIC;
+  control->version = CONTROL_VERSION;
+}
+
+// ---------------------------------------------------------------------------
+void resize_control_block(int runs) {
+  if(control)
+    munmap(control, CONTROL_SIZE(control->runs));
+  void* mem = MAP_FAILED;
+  if(!ftruncate(control_fd, CONTROL_SIZE(runs)))
+    mem = mmap(NULL, CONTROL_SIZE(runs), PROT_READ | PROT_WRITE, MAP_SHARED, control_fd, 0);
+  if(mem == MAP_FAILED) {
+    log("{red}Could not map the control block, aborting now{/red}");
+    exit(1);
+  }
+  control = mem;
+  control->runs = runs;
+}
+
+// ---------------------------------------------------------------------------
+void arm_sites(const ProfileEntry* profile, int injections) {
+  // every run fails at its own site, the runs keep the order of the profile
+  int i;
+  resize_control_block(injections);
+  for(i = 0; i < injections; i++) {
+    memset(CONTROL_RECORD(control, RUN_SLOT(i)), 0, sizeof(RunRecord));
+    CONTROL_RECORD(control, RUN_SLOT(i))->armed = profile[i].key;
+  }
+}
+
+// ---------------------------------------------------------------------------
+int create_memory_file(const char* name) {
+  int fd = memfd_create(name, MFD_CLOEXEC);
+  if(fd == -1) {
+    log("{red}Could not create memory file '%s', aborting now{/red}", name);
+    exit(1);
+  }
+  return fd;
+}
+
+// ---------------------------------------------------------------------------
+int create_trace_file(const char* name) {
+  // appended by all threads of the target, each block with a single write
+  int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  CallTraceHeader header = { CALLS_MAGIC, CALLS_VERSION };
+  if(fd == -1 || write(fd, &header, sizeof(header)) != sizeof(header)) {
+    log("{red}Need write access to file '%s'!{/red}", name);
+    exit(1);
   }
+  return fd;
+}
+
+// ---------------------------------------------------------------------------
+int inherit_fd(int fd) {
+  // called in the child, the run itself needs the file
+  if(fd != -1)
+    fcntl(fd, F_SETFD, 0);
+  return fd;
+}
+
+// ---------------------------------------------------------------------------
+void get_fd_env(char* env, const char* name, int fd) {
+  snprintf(env, 32, "%s=%d", name, fd);
 }
 
 // ---------------------------------------------------------------------------
@@ -314,36 +435,134 @@ void list_modules() {
 }
 
 // ---------------------------------------------------------------------------
-void clear_crash_report() {
-  FILE* f = fopen("crash", "wb");
-  fclose(f);
+int get_crash_address(int run, void** crash, void** fault_addr) {
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  if(!__atomic_load_n(&r->crashed, __ATOMIC_ACQUIRE))
+    return 0;
+  *fault_addr = (void*) (size_t) r->crash.fault;
+  *crash = (void*) (size_t) r->crash.crash;
+  return 1;
 }
 
 // ---------------------------------------------------------------------------
-int get_crash_address(void** crash, void** fault_addr) {
-  FILE* f = fopen("crash", "rb");
-  if(!f)
-    return 0;
-  CrashEntry e;
-  int s = fread(&e, sizeof(CrashEntry), 1, f);
-  if(s == 0) {
-    fclose(f);
+int get_crash_stack(int run, uint64_t* frames) {
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  if(!__atomic_load_n(&r->crashed, __ATOMIC_ACQUIRE))
     return 0;
+
+  // the crashing instruction first, the stack usually starts with it as well
+  int depth = 0;
+  uint32_t i = 0, stack_depth = r->stack_depth < CRASH_STACK_DEPTH ? r->stack_depth : CRASH_STACK_DEPTH;
+  frames[depth++] = r->crash.crash;
+  if(stack_depth && r->stack[0] == r->crash.crash)
+    i++;
+  for(; i < stack_depth && depth < bucket_depth; i++) {
+    frames[depth++] = r->stack[i];
   }
-  *fault_addr = (void*) e.fault;
-  *crash = (void*) e.crash;
-  fclose(f);
-  return 1;
+  return depth;
+}
+
+// ---------------------------------------------------------------------------
+void add_crash(cmap* crashes, const uint64_t* frames, int depth, const void* fault) {
+  char signature[BUCKET_SIGNATURE_LENGTH];
+  int i, pos = 0;
+  for(i = 0; i < depth; i++) {
+    pos += snprintf(signature + pos, sizeof(signature) - pos, "%s%llx", i ? " " : "", (unsigned long long) frames[i]);
+  }
+  signature[pos] = 0;
+
+  CrashBucket* bucket = (CrashBucket*) map(crashes)->get(signature);
+  if(!bucket) {
+    bucket = (CrashBucket*) calloc(1, sizeof(CrashBucket));
+    if(!bucket)
+      return;
+    strcpy(bucket->signature, signature);
+    memcpy(bucket->frames, frames, depth * sizeof(uint64_t));
+    bucket->depth = depth;
+    map_initialize(bucket->faults, MAP_GENERAL);
+    map(crashes)->set(bucket->signature, bucket);
+  }
+  bucket->count++;
+  map(bucket->faults)->set(fault, (void*) ((size_t) map(bucket->faults)->get(fault) + 1));
+}
+
+// ---------------------------------------------------------------------------
+void destroy_crashes(cmap* crashes) {
+  cmap_iterator* it = map(crashes)->iterator();
+  while(!map_iterator(it)->end()) {
+    CrashBucket* bucket = (CrashBucket*) map_iterator(it)->value();
+    map(bucket->faults)->destroy();
+    free(bucket);
+    map_iterator(it)->next();
+  }
+  map_iterator(it)->destroy();
+  map(crashes)->destroy();
+}
+
+// ---------------------------------------------------------------------------
+void save_profile(const ProfileFile* profile) {
+  int fd = open("profile", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd == -1 || !profile_write(profile, fd))
+    log("{red}Could not write file 'profile'!{/red}");
+  if(fd != -1)
+    close(fd);
+}
+
+// ---------------------------------------------------------------------------
+void open_result_cache(char* const argv[], int argc, int arch) {
+  if(settings.trace_heap) {
+    log("Heap tracing needs a full run, result cache disabled");
+    return;
+  }
+
+  // the key covers faint itself, the binary with its libraries, the
+  // arguments and all settings which change the sites or the outcome
+  int i;
+  cache_add_string(&cache, VERSION);
+  if(arch == ARCH_32)
+    cache_add(&cache, fault_lib32, fault_lib32_end - fault_lib32);
+  else
+    cache_add(&cache, fault_lib, fault_lib_end - fault_lib);
+  cache_add_binary(&cache, get_filename());
+  for(i = 1; i < argc; i++) {
+    cache_add_string(&cache, argv[i]);
+  }
+  // relative paths in the arguments depend on where faint runs
+  char cwd[CACHE_PATH_LENGTH];
+  if(getcwd(cwd, sizeof(cwd)))
+    cache_add_string(&cache, cwd);
+  cache_add(&cache, &settings.modules, sizeof(settings.modules));
+  cache_add(&cache, &settings.stack_depth, sizeof(settings.stack_depth));
+  cache_add(&cache, &valgrind, sizeof(valgrind));
+
+  if(!cache_open(&cache, cache_directory, refresh_cache))
+    log("{red}Could not open result cache in '%s'{/red}", cache.base);
+  else
+    log("Result cache: %s", cache.directory);
+}
+
+// ---------------------------------------------------------------------------
+int restore_cached_runs(const ProfileEntry* profile, int injections) {
+  int i, cached = 0;
+  for(i = 0; i < injections; i++) {
+    const CachedRun* run = cache_find_run(&cache, profile[i].key);
+    if(!run)
+      continue;
+    // the record looks as if the run just finished, explorations skip it
+    RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(i));
+    uint64_t armed = r->armed;
+    *r = run->record;
+    r->armed = armed;
+    r->status = run->status;
+    r->explored = EXPLORE_DONE;
+    cached++;
+  }
+  return cached;
 }
 
 // ---------------------------------------------------------------------------
 void cleanup() {
-  remove("settings");
-  if(!profile_only)
-    remove("profile");
-  remove("heap");
-  remove("crash");
-  remove("fault_inject.so");
+  release_symbols();
   log("\n\nfinished successfully!");
 }
 
@@ -416,6 +635,53 @@ int parse_commandline(int argc, char* argv[]) {
         inject_only = 1;
       } else if(!strcmp(cmd, "trace-heap")) {
         settings.trace_heap = 1;
+      } else if(!strcmp(cmd, "trace-calls") && i != argc - 1) {
+        trace_calls = argv[i + 1];
+        i++;
+      } else if(!strcmp(cmd, "show-trace") && i != argc - 1) {
+        show_call_trace = argv[i + 1];
+        i++;
+      } else if(!strcmp(cmd, "jobs") && i != argc - 1) {
+        jobs = atoi(argv[i + 1]);
+        if(jobs < 1) {
+          log("{red}Number of jobs has to be at least 1!{/red}");
+          exit(1);
+        }
+        i++;
+      } else if(!strcmp(cmd, "keep-aslr")) {
+        keep_aslr = 1;
+      } else if(!strcmp(cmd, "fork-server")) {
+        fork_server = 1;
+      } else if(!strcmp(cmd, "explore")) {
+        explore = 1;
+      } else if(!strcmp(cmd, "timeout") && i != argc - 1) {
+        timeout = atof(argv[i + 1]);
+        if(timeout < 0) {
+          log("{red}Timeout can not be negative!{/red}");
+          exit(1);
+        }
+        i++;
+      } else if(!strcmp(cmd, "stack-depth") && i != argc - 1) {
+        settings.stack_depth = atoi(argv[i + 1]);
+        if(settings.stack_depth < 1 || settings.stack_depth > MAX_STACK_DEPTH) {
+          log("{red}Stack depth has to be between 1 and %d!{/red}", MAX_STACK_DEPTH);
+          exit(1);
+        }
+        i++;
+      } else if(!strcmp(cmd, "bucket-depth") && i != argc - 1) {
+        bucket_depth = atoi(argv[i + 1]);
+        if(bucket_depth < 1 || bucket_depth > CRASH_STACK_DEPTH) {
+          log("{red}Bucket depth has to be between 1 and %d!{/red}", CRASH_STACK_DEPTH);
+          exit(1);
+        }
+        i++;
+      } else if(!strcmp(cmd, "no-cache")) {
+        no_cache = 1;
+      } else if(!strcmp(cmd, "refresh")) {
+        refresh_cache = 1;
+      } else if(!strcmp(cmd, "cache-dir") && i != argc - 1) {
+        cache_directory = argv[i + 1];
+        i++;
       } else if(!strcmp(cmd, "version")) {
         printf("faint %s\n", VERSION);
         exit(0);
@@ -429,7 +695,7 @@ int parse_commandline(int argc, char* argv[]) {
     }
   }
   write_settings();
-  for(i = 0; i < get_module_count(); i++) {
+  for(i = 0; i < get_module_count() && !show_call_trace; i++) {
     if(settings.modules & (1 << i)) {
       log("Activate module '{yellow}%s{/yellow}'", get_module(i));
     }
@@ -439,16 +705,25 @@ int parse_commandline(int argc, char* argv[]) {
 }
 
 // ---------------------------------------------------------------------------
-void print_fault_position(const char* binary, const void* fault, int type, int count) {
+void print_fault_position(const char* binary, const ProfileEntry* site, int count) {
   char m_file[256], m_function[256];
   int m_line;
-  if(get_file_and_line(binary, fault, m_file, &m_line, m_function)) {
+  if(get_file_and_line(binary, (void*) site->address, m_file, &m_line, m_function)) {
     if(count != -1) {
-      log(" >  [{yellow}%s{/yellow}] {cyan}%s{/cyan} in %s line {cyan}%d{/cyan}: %d calls", get_module(type),
+      log(" >  [{yellow}%s{/yellow}] {cyan}%s{/cyan} in %s line {cyan}%d{/cyan}: %d calls", get_module(site->type),
           m_function, m_file, m_line, count);
     } else {
-      log(" >  [{yellow}%s{/yellow}] {cyan}%s{/cyan} in %s line {cyan}%d{/cyan}", get_module(type), m_function, m_file,
-          m_line);
+      log(" >  [{yellow}%s{/yellow}] {cyan}%s{/cyan} in %s line {cyan}%d{/cyan}", get_module(site->type), m_function,
+          m_file, m_line);
+    }
+    // calling context of the site
+    int i;
+    for(i = 1; i < site->depth; i++) {
+      if(get_file_and_line(binary, (void*) site->stack[i], m_file, &m_line, m_function)) {
+        log("      called from {cyan}%s{/cyan} in %s line {cyan}%d{/cyan}", m_function, m_file, m_line);
+      } else {
+        log("      called from %p", (void*) site->stack[i]);
+      }
     }
   } else {
     log(" > N/A ({red}maybe you forgot to compile with -g?{/red})");
@@ -456,37 +731,114 @@ void print_fault_position(const char* binary, const void* fault, int type, int c
 }
 
 // ---------------------------------------------------------------------------
-void crash_details(const char *binary, const void *crash, const void *fault, cmap *types, size_t base) {
+void signal_details(int run) {
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  // the address is only given for faults, a null pointer access is 0
+  int fault = r->signal == SIGSEGV || r->signal == SIGBUS || r->signal == SIGFPE || r->signal == SIGILL;
+  if(fault)
+    log("  > {red}signal{/red}: %s, fault address %p", strsignal(r->signal), (void*) (size_t) r->data_address);
+  else
+    log("  > {red}signal{/red}: %s", strsignal(r->signal));
+}
+
+// ---------------------------------------------------------------------------
+void crash_details(const char *binary, const void *crash, const void *fault, const ProfileFile* sites) {
   char crash_file[256], fault_file[256], crash_fnc[256], fault_fnc[256];
   int crash_line, fault_line;
 
-  //printf("%zx (- %zx)\n", (size_t)crash, base);
-  size_t crash_fixup = (size_t)crash;
-  size_t fault_fixup = (size_t)fault;
-  if(base && base <= (size_t)crash && base <= (size_t)fault) {
-      crash_fixup -= base;
-      fault_fixup -= base;
-  }
+  // the fault is the site key, resolve it to the calling address
+  const ProfileEntry* site = profile_find_site(sites, (uint64_t) (size_t) fault);
+  size_t type = site ? site->type : 0;
+  if(site)
+    fault = (void*) site->address;
+
 
-  log("{red}Crashed{/red} at %p, caused by %p [%s]", crash, fault, get_module((size_t) map(types)->get(fault)));
-  if(get_file_and_line(binary, (void*)crash_fixup, crash_file, &crash_line, crash_fnc)
-      && get_file_and_line(binary, (void*)fault_fixup, fault_file, &fault_line, fault_fnc)) {
+  log("{red}Crashed{/red} at %p, caused by %p [%s]", crash, fault, get_module(type));
+  if(get_file_and_line(binary, crash, crash_file, &crash_line, crash_fnc)
+      && get_file_and_line(binary, fault, fault_file, &fault_line, fault_fnc)) {
     log("  > {red}crash{/red}: {cyan}%s{/cyan} (%s) line {cyan}%d{/cyan}", crash_fnc, crash_file, crash_line);
     log("  > {yellow}%s{/yellow}: {cyan}%s{/cyan} (%s) line {cyan}%d{/cyan}",
-        get_module((size_t) map(types)->get(fault)), fault_fnc, fault_file, fault_line);
+        get_module(type), fault_fnc, fault_file, fault_line);
   } else {
     log("No crash details available (maybe you forgot to compile with -g?)");
   }
 }
 
 // ---------------------------------------------------------------------------
-void summary(const char* binary, int crash_count, int injections, cmap* crashes, cmap* types, size_t app_base) {
+int compare_buckets(const void* a, const void* b) {
+  // most frequent crashes first
+  const CrashBucket* ba = *(CrashBucket* const *) a;
+  const CrashBucket* bb = *(CrashBucket* const *) b;
+  if(ba->count != bb->count)
+    return bb->count - ba->count;
+  return strcmp(ba->signature, bb->signature);
+}
+
+// ---------------------------------------------------------------------------
+int compare_bucket_faults(const void* a, const void* b) {
+  const size_t* fa = (const size_t*) a;
+  const size_t* fb = (const size_t*) b;
+  if(fa[1] != fb[1])
+    return fa[1] < fb[1] ? 1 : -1;
+  return fa[0] < fb[0] ? -1 : (fa[0] > fb[0]);
+}
+
+// ---------------------------------------------------------------------------
+void bucket_details(const char* binary, const CrashBucket* bucket, const ProfileFile* sites) {
+  char file[256], fnc[256];
+  int i, line;
+
+  log("{red}Crashed{/red} %d time(s) at %p", bucket->count, (void*) (size_t) bucket->frames[0]);
+  for(i = 0; i < bucket->depth; i++) {
+    void* frame = (void*) (size_t) bucket->frames[i];
+    const char* name = i ? "called from" : "crash";
+    // callers are return addresses, the call itself is right before
+    if(get_file_and_line(binary, (char*) frame - (i ? 1 : 0), file, &line, fnc))
+      log("  > {red}%s{/red}: {cyan}%s{/cyan} (%s) line {cyan}%d{/cyan}", name, fnc, file, line);
+    else
+      log("  > {red}%s{/red}: %p", name, frame);
+  }
+
+  // (fault, count) pairs, the fault is the site key
+  size_t count = 0, *faults = (size_t*) malloc(bucket->faults->entries * 2 * sizeof(size_t) + 1);
+  if(!faults)
+    return;
+  cmap_iterator* it = map(bucket->faults)->iterator();
+  while(!map_iterator(it)->end()) {
+    faults[count * 2] = (size_t) map_iterator(it)->key();
+    faults[count * 2 + 1] = (size_t) map_iterator(it)->value();
+    count++;
+    map_iterator(it)->next();
+  }
+  map_iterator(it)->destroy();
+  qsort(faults, count, 2 * sizeof(size_t), compare_bucket_faults);
+
+  for(i = 0; i < count; i++) {
+    const ProfileEntry* site = profile_find_site(sites, faults[i * 2]);
+    size_t type = site ? site->type : 0;
+    void* fault = site ? (void*) (size_t) site->address : (void*) faults[i * 2];
+    if(get_file_and_line(binary, fault, file, &line, fnc))
+      log("  > {yellow}%s{/yellow}: {cyan}%s{/cyan} (%s) line {cyan}%d{/cyan}, %d time(s)",
+          get_module(type), fnc, file, line, (int) faults[i * 2 + 1]);
+    else
+      log("  > {yellow}%s{/yellow}: %p, %d time(s)", get_module(type), fault, (int) faults[i * 2 + 1]);
+  }
+  free(faults);
+}
+
+// ---------------------------------------------------------------------------
+void summary(const char* binary, int* results, int injections, cmap* crashes, const ProfileFile* sites) {
+  int crash_count = results[RUN_CRASHED];
   log("\n======= SUMMARY =======\n");
   log("Crashed at %d from %d injections", crash_count, injections);
+  log("Timed out: %d, exited: %d", results[RUN_TIMEOUT], results[RUN_EXITED]);
 
-  int unique = 0;
+  int i, unique = 0;
+  CrashBucket** buckets = (CrashBucket**) malloc(crashes->entries * sizeof(CrashBucket*) + 1);
   cmap_iterator* it = map(crashes)->iterator();
   while(!map_iterator(it)->end()) {
+    if(buckets)
+      buckets[unique] = (CrashBucket*) map_iterator(it)->value();
     unique++;
     map_iterator(it)->next();
   }
@@ -494,100 +846,130 @@ void summary(const char* binary, int crash_count, int injections, cmap* crashes,
 
   log("Unique crashes: %d\n", unique);
 
-  if(crash_count > 0) {
+  if(crash_count > 0 && buckets) {
     log("Crash details:");
 
-    it = map(crashes)->iterator();
-    while(!map_iterator(it)->end()) {
-      void* crash = map_iterator(it)->key();
-      void* fault = map_iterator(it)->value();
+    qsort(buckets, unique, sizeof(CrashBucket*), compare_buckets);
+    for(i = 0; i < unique; i++) {
       log("");
-        crash_details(binary, crash, fault, types, app_base);
-      map_iterator(it)->next();
+      bucket_details(binary, buckets[i], sites);
     }
-    map_iterator(it)->destroy();
-  } else {
+  } else if(!crash_count) {
     log("{green}Everything ok, no crashes detected!{/green}");
   }
+  free(buckets);
 }
 
 // ---------------------------------------------------------------------------
-int parse_profiling(size_t** addr, size_t** count, size_t** type, size_t* calls, cmap* types) {
-
-  FILE* f = fopen("profile", "rb");
-  if(!f) {
+int parse_profiling(int fd, int check_target, ProfileFile* profile, size_t* calls) {
+  // the profile is mapped, the sites are never copied
+  int error = profile_open(fd, profile);
+  if(error == PROFILE_OK && check_target)
+    error = profile_check_target(profile, get_filename());
+  if(error == PROFILE_EMPTY) {
     log("{red}No trace generated, aborting now{/red}\n");
     exit(1);
+  } else if(error != PROFILE_OK) {
+    log("{red}Can not use the profile: %s{/red}", profile_error(error));
+    exit(1);
   }
-  fseek(f, 0, SEEK_END);
-  size_t fsize = ftell(f);
-  size_t injections = fsize / sizeof(ProfileEntry);
-  fseek(f, 0, SEEK_SET);
-
-  *addr = malloc(sizeof(size_t) * injections);
-  *count = malloc(sizeof(size_t) * injections);
-  *type = malloc(sizeof(size_t) * injections);
 
-  int i;
+  size_t i;
   *calls = 0;
-  for(i = 0; i < injections; i++) {
-    ProfileEntry e;
-    if(!fread(&e, sizeof(ProfileEntry), 1, f)) {
-      break;
-    }
-
-    (*addr)[i] = (size_t) e.address;
-    (*count)[i] = (size_t) e.count;
-    (*type)[i] = (size_t) e.type;
-    map(types)->set((void*) ((*addr)[i]), (void*) ((*type)[i]));
-    (*calls) += (*count)[i];
+  for(i = 0; i < profile->count; i++) {
+    (*calls) += profile->sites[i].count;
   }
-  fclose(f);
-  return injections;
+  return profile->count;
+}
+
+// ---------------------------------------------------------------------------
+int compare_heap_events(const void* a, const void* b) {
+  uint64_t s1 = ((const HeapEvent*) a)->sequence, s2 = ((const HeapEvent*) b)->sequence;
+  return s1 < s2 ? -1 : s1 > s2;
 }
 
 // ---------------------------------------------------------------------------
-int parse_heap(size_t** addr, size_t** size, size_t* blocks, size_t* total_size) {
-  FILE* f = fopen("heap", "rb");
+int parse_heap(int fd, size_t** addr, size_t** size, size_t* blocks, size_t* total_size) {
+  FILE* f = NULL;
+  int copy = fd == -1 ? -1 : dup(fd);
+  if(copy != -1 && lseek(copy, 0, SEEK_SET) == 0)
+    f = fdopen(copy, "rb");
   if(!f) {
+    if(copy != -1)
+      close(copy);
     log("{red}No heap profile generated!{/red}\n");
     return 0;
   }
-  fseek(f, 0, SEEK_END);
-  size_t fsize = ftell(f);
-  size_t heap_blocks = fsize / sizeof(HeapEntry);
-  fseek(f, 0, SEEK_SET);
 
+  // the threads of the target flush their events in any order
+  size_t i, n, count = 0, capacity = 1024;
+  HeapEvent* events = malloc(capacity * sizeof(HeapEvent));
+  while(events && (n = fread(events + count, sizeof(HeapEvent), capacity - count, f)) > 0) {
+    count += n;
+    if(count == capacity) {
+      capacity *= 2;
+      HeapEvent* grown = realloc(events, capacity * sizeof(HeapEvent));
+      if(!grown)
+        free(events);
+      events = grown;
+    }
+  }
+  fclose(f);
+  if(!events) {
+    log("{red}Heap profile is too large!{/red}\n");
+    return 0;
+  }
+  qsort(events, count, sizeof(HeapEvent), compare_heap_events);
+
+  // replay the event log, only blocks which are never freed remain
+  map_create(live_size, MAP_GENERAL);
+  map_create(live_site, MAP_GENERAL);
+  for(i = 0; i < count; i++) {
+    void* block = (void*) (size_t) events[i].block;
+    if(events[i].type == HEAP_ALLOC) {
+      map(live_size)->set(block, (void*) (size_t) events[i].size);
+      map(live_site)->set(block, (void*) (size_t) events[i].address);
+    } else if(events[i].type == HEAP_FREE) {
+      map(live_size)->unset(block);
+      map(live_site)->unset(block);
+    }
+  }
+  free(events);
+
+  size_t heap_blocks = live_size->entries;
   *addr = malloc(sizeof(size_t) * heap_blocks);
   *size = malloc(sizeof(size_t) * heap_blocks);
 
-  int i;
   *total_size = 0;
-  for(i = 0; i < heap_blocks; i++) {
-    HeapEntry e;
-    if(!fread(&e, sizeof(HeapEntry), 1, f)) {
-      break;
-    }
-
-    (*addr)[i] = (size_t) e.address;
-    (*size)[i] = (size_t) e.size;
-    *total_size += e.size;
+  i = 0;
+  cmap_iterator* it = map(live_size)->iterator();
+  while(!map_iterator(it)->end()) {
+    void* block = map_iterator(it)->key();
+    (*addr)[i] = (size_t) map(live_site)->get(block);
+    (*size)[i] = (size_t) map_iterator(it)->value();
+    *total_size += (*size)[i];
+    i++;
+    map_iterator(it)->next();
   }
+  map_iterator(it)->destroy();
+  map(live_size)->destroy();
+  map(live_site)->destroy();
 
-  fclose(f);
   *blocks = heap_blocks;
   return 1;
 }
 
 // ---------------------------------------------------------------------------
-void show_heap() {
+void show_heap(int fd) {
   size_t *addr, *size, blocks, total_size;
-  if(!parse_heap(&addr, &size, &blocks, &total_size)) {
+  if(!parse_heap(fd, &addr, &size, &blocks, &total_size)) {
     return;
   }
   log("\n");
   if(blocks == 0) {
     log("{green}All heap blocks are freed, no memory leak found{/green}");
+    free(addr);
+    free(size);
     return;
   }
   int i;
@@ -601,4 +983,488 @@ void show_heap() {
     }
   }
   log("\n{red}Heap summary: lost %d bytes in %d blocks{/red}\n", total_size, blocks);
+  free(addr);
+  free(size);
+}
+
+// ---------------------------------------------------------------------------
+void print_injection_header(const ProfileEntry* site, int run) {
+  log("\n\n{green}Inject fault #%d{/green}", (run + 1));
+  log("Fault position:");
+  print_fault_position(get_filename(), site, -1);
+  log("");
+}
+
+// ---------------------------------------------------------------------------
+void prepare_injection(const ProfileEntry* site, int run) {
+  // every run starts with an empty record
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  r->injected = 0;
+  r->crashed = 0;
+  r->timed_out = 0;
+
+  // a single run can write directly to the terminal
+  if(jobs == 1)
+    print_injection_header(site, run);
+  fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+pid_t start_injection(char* const args[], const ProfileEntry* site, int run, int* heap_fd, int* output_fd) {
+  prepare_injection(site, run);
+  if(settings.trace_heap)
+    *heap_fd = create_memory_file("faint-heap");
+  // output of parallel runs is shown once the run is reported
+  if(jobs > 1)
+    *output_fd = create_memory_file("faint-output");
+
+  pid_t pid = fork();
+  if(pid)
+    return pid;
+
+  // -> inject
+  setup_child();
+  if(*output_fd != -1) {
+    dup2(*output_fd, STDOUT_FILENO);
+    dup2(*output_fd, STDERR_FILENO);
+  }
+  char run_env[32], control_env[32], heap_env[32];
+  snprintf(run_env, sizeof(run_env), "%s=%d", RUN_ENV, run);
+  get_fd_env(control_env, CONTROL_ENV, control_fd);
+  get_fd_env(heap_env, HEAP_ENV, inherit_fd(*heap_fd));
+  char* const envs[] = { preload_env, run_env, control_env, heap_env, NULL };
+  execve(args[0], args, envs);
+  log("Could not execute %s", get_filename());
+  exit(0);
+}
+
+// ---------------------------------------------------------------------------
+void show_output(const RunOutput* output) {
+  if(output->fd == -1)
+    return;
+  char buffer[4096];
+  off_t pos = output->offset;
+  ssize_t n;
+  fflush(stdout);
+  while(output->size == -1 || pos < output->offset + output->size) {
+    size_t len = sizeof(buffer);
+    if(output->size != -1 && (off_t) len > output->offset + output->size - pos)
+      len = output->offset + output->size - pos;
+    if((n = pread(output->fd, buffer, len, pos)) <= 0)
+      break;
+    if(fwrite(buffer, 1, n, stdout) != (size_t) n)
+      break;
+    pos += n;
+  }
+  fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+int report_injection(const ProfileEntry* site, int run, int status, int timed_out, const RunOutput* output, int heap_fd,
+    cmap* crashes, const ProfileFile* sites) {
+  int result = RUN_EXITED;
+
+  if(output) {
+    print_injection_header(site, run);
+    show_output(output);
+  }
+  void *crash, *fault;
+  if(timed_out) {
+    log("{red}Timed out{/red}, killed after %.1f s", timeout);
+    result = RUN_TIMEOUT;
+  } else {
+    show_return_details(status);
+    if(get_crash_address(run, &crash, &fault)) {
+      crash_details(get_filename(), crash, fault, sites);
+      signal_details(run);
+      uint64_t frames[CRASH_STACK_DEPTH];
+      add_crash(crashes, frames, get_crash_stack(run, frames), fault);
+      result = RUN_CRASHED;
+    } else if(WIFSIGNALED(status)) {
+      result = RUN_CRASHED;
+    } else if(!CONTROL_RECORD(control, RUN_SLOT(run))->injected) {
+      log("{yellow}Site was not reached, no fault injected{/yellow}");
+    }
+  }
+
+  if(settings.trace_heap) {
+    show_heap(heap_fd);
+    if(heap_fd != -1)
+      close(heap_fd);
+  }
+  log("{green}Injection #%d done{/green}", (run + 1));
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+int start_fork_server(char* const args[], ForkServer* server) {
+  // a socket, so each request can carry the output file of its run
+  int control[2], status[2];
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, control))
+    return 0;
+  if(pipe(status)) {
+    close(control[0]);
+    close(control[1]);
+    return 0;
+  }
+  // our ends must not leak into other runs
+  fcntl(control[1], F_SETFD, FD_CLOEXEC);
+  fcntl(status[0], F_SETFD, FD_CLOEXEC);
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if(!pid) {
+    setup_child();
+    close(control[1]);
+    close(status[0]);
+    char run_env[32], server_env[64], control_env[32];
+    snprintf(run_env, sizeof(run_env), "%s=server", RUN_ENV);
+    snprintf(server_env, sizeof(server_env), "%s=%d,%d", FORK_SERVER_ENV, control[0], status[1]);
+    get_fd_env(control_env, CONTROL_ENV, control_fd);
+    char* const envs[] = { preload_env, run_env, server_env, control_env, NULL };
+    execve(args[0], args, envs);
+    _exit(1);
+  }
+  close(control[0]);
+  close(status[1]);
+  server->pid = pid;
+  server->control = control[1];
+  server->status = status[0];
+  server->run = -1;
+
+  // the server is ready as soon as the target reached main
+  int32_t hello;
+  if(pid == -1 || read(server->status, &hello, sizeof(hello)) != sizeof(hello)) {
+    stop_fork_server(server);
+    return 0;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void stop_fork_server(ForkServer* server) {
+  if(!server->pid)
+    return;
+  // closing the control socket lets the server exit
+  close(server->control);
+  close(server->status);
+  if(server->pid > 0)
+    waitpid(server->pid, NULL, 0);
+  server->pid = 0;
+}
+
+// ---------------------------------------------------------------------------
+pid_t dispatch_fork_server(ForkServer* server, const ProfileEntry* site, int run, int* output_fd) {
+  prepare_injection(site, run);
+  // output of parallel runs is shown once the run is reported
+  if(jobs > 1)
+    *output_fd = create_memory_file("faint-output");
+
+  ForkRequest request;
+  request.run = run;
+  request.capture_output = (*output_fd != -1);
+  struct iovec data = { &request, sizeof(request) };
+  char buffer[CMSG_SPACE(sizeof(int))];
+  memset(buffer, 0, sizeof(buffer));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  // the output file travels along with the request
+  if(request.capture_output) {
+    message.msg_control = buffer;
+    message.msg_controllen = sizeof(buffer);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), output_fd, sizeof(int));
+  }
+  int32_t pid;
+  if(sendmsg(server->control, &message, MSG_NOSIGNAL) != sizeof(request)
+      || read(server->status, &pid, sizeof(pid)) != sizeof(pid)) {
+    stop_fork_server(server);
+    pid = -1;
+  }
+  if(pid <= 0 && *output_fd != -1) {
+    close(*output_fd);
+    *output_fd = -1;
+  }
+  if(pid > 0)
+    server->run = run;
+  return pid;
+}
+
+// ---------------------------------------------------------------------------
+int start_fork_servers(char* const args[], ForkServer** servers) {
+  if(settings.trace_heap) {
+    log("Heap tracing needs a full run, fork server disabled");
+    return 0;
+  }
+  *servers = calloc(jobs, sizeof(ForkServer));
+  if(!*servers)
+    return 0;
+
+  // fork servers never inject until they get a run
+  settings.limit = -1;
+  set_mode(INJECT);
+
+  int i;
+  for(i = 0; i < jobs; i++) {
+    if(!start_fork_server(args, &(*servers)[i]))
+      break;
+  }
+  if(i < jobs) {
+    log("{red}Could not start fork server, falling back to execve{/red}");
+    stop_fork_servers(*servers, i);
+    free(*servers);
+    *servers = NULL;
+    return 0;
+  }
+  log("Started %d fork server(s)", jobs);
+  return jobs;
+}
+
+// ---------------------------------------------------------------------------
+void stop_fork_servers(ForkServer* servers, int count) {
+  int i;
+  for(i = 0; i < count; i++) {
+    stop_fork_server(&servers[i]);
+  }
+}
+
+// ---------------------------------------------------------------------------
+void setup_child() {
+  // a group of its own, a timeout kills everything the target started
+  setpgid(0, 0);
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
+// ---------------------------------------------------------------------------
+void explore_injections(char* const args[], int injections) {
+  int i;
+  if(settings.trace_heap) {
+    log("Heap tracing needs a full run, exploration disabled");
+    return;
+  }
+
+  // one run of the target forks an injection run at the first call of every site
+  settings.limit = -1;
+  settings.jobs = jobs;
+  // every forked run gets its own deadline
+  settings.timeout = timeout > 0 ? timeout : 0;
+  set_mode(EXPLORE);
+  log("{green}Exploration start{/green}");
+  fflush(stdout);
+
+  // the runs write to their own memory file, which is appended to this one
+  exploration_output = create_memory_file("faint-exploration");
+  pid_t pid = fork();
+  if(!pid) {
+    setup_child();
+    char run_env[32], control_env[32], output_env[32];
+    snprintf(run_env, sizeof(run_env), "%s=explore", RUN_ENV);
+    get_fd_env(control_env, CONTROL_ENV, control_fd);
+    get_fd_env(output_env, OUTPUT_ENV, inherit_fd(exploration_output));
+    char* const envs[] = { preload_env, run_env, control_env, output_env, NULL };
+    execve(args[0], args, envs);
+    _exit(1);
+  }
+  // the exploration may take as long as all the runs it forks
+  int status;
+  if(pid > 0 && wait_supervised(pid, timeout > 0 ? timeout * (injections + 1) : 0, &status) > 0)
+    log("{red}Exploration timed out{/red}");
+
+  parse_exploration_output(injections);
+  int explored = 0, skipped = 0;
+  char timed_out;
+  for(i = 0; i < injections; i++) {
+    if(get_exploration_status(i, &status, &timed_out))
+      explored++;
+    else if(CONTROL_RECORD(control, RUN_SLOT(i))->explored == EXPLORE_SKIPPED)
+      skipped++;
+  }
+  log("{green}Exploration done{/green}, %d of %d sites explored", explored, injections);
+  if(skipped)
+    log("%d site(s) reached with several threads running, they get a normal run", skipped);
+}
+
+// ---------------------------------------------------------------------------
+void parse_exploration_output(int injections) {
+  explored_output = malloc(injections * sizeof(RunOutput) + 1);
+  if(!explored_output)
+    return;
+  int i;
+  for(i = 0; i < injections; i++) {
+    explored_output[i].fd = -1;
+  }
+
+  // a record per run, an incomplete last one is dropped
+  struct stat st;
+  if(fstat(exploration_output, &st))
+    return;
+  off_t pos = 0;
+  OutputRecord record;
+  while(pread(exploration_output, &record, sizeof(record), pos) == sizeof(record)) {
+    pos += sizeof(record);
+    if(record.size > (uint64_t) (st.st_size - pos))
+      break;
+    if(record.run >= 0 && record.run < injections) {
+      explored_output[record.run].fd = exploration_output;
+      explored_output[record.run].offset = pos;
+      explored_output[record.run].size = record.size;
+    }
+    pos += record.size;
+  }
+}
+
+// ---------------------------------------------------------------------------
+int get_exploration_status(int run, int* status, char* timed_out) {
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  if(__atomic_load_n(&r->explored, __ATOMIC_ACQUIRE) != EXPLORE_DONE)
+    return 0;
+  // the exploration kills runs after the same timeout as the supervisor
+  *status = r->status;
+  *timed_out = r->timed_out != 0;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void run_injections(char* const args[], const ProfileEntry* profile, int injections, cmap* crashes, const ProfileFile* sites,
+    int* results) {
+  int i;
+  int* status = calloc(injections, sizeof(int));
+  char* done = calloc(injections, 1);
+  char* timed_out = calloc(injections, 1);
+  char* explored = calloc(injections, 1);
+  char* cached = calloc(injections, 1);
+  int* heap = malloc(injections * sizeof(int));
+  RunOutput* output = malloc(injections * sizeof(RunOutput));
+  Supervisor supervisor;
+  if((injections && (!status || !done || !timed_out || !explored || !cached || !heap || !output))
+      || !supervisor_init(&supervisor, jobs)) {
+    log("{red}Out of memory, aborting now{/red}");
+    exit(1);
+  }
+  for(i = 0; i < injections; i++) {
+    heap[i] = -1;
+    output[i].fd = -1;
+    output[i].offset = 0;
+    output[i].size = -1;
+  }
+  set_mode(INJECT);
+
+  ForkServer* servers = NULL;
+  int server_count = 0;
+  if(fork_server)
+    server_count = start_fork_servers(args, &servers);
+
+  int next = 0, reported = 0;
+  while(reported < injections) {
+    // results are reported in the order of the injection sites
+    while(reported < injections && done[reported]) {
+      if(cached[reported]) {
+        print_injection_header(&profile[reported], reported);
+        log("{cyan}Cached result{/cyan}");
+      }
+      results[report_injection(&profile[reported], reported, status[reported], timed_out[reported],
+          !cached[reported] && (jobs > 1 || explored[reported]) ? &output[reported] : NULL, heap[reported], crashes,
+          sites)]++;
+      if(output[reported].fd != -1 && output[reported].fd != exploration_output)
+        close(output[reported].fd);
+      // timeouts depend on the load of the machine, they are tried again
+      if(!cached[reported] && !timed_out[reported])
+        cache_save_run(&cache, profile[reported].key, status[reported], CONTROL_RECORD(control, RUN_SLOT(reported)));
+      reported++;
+    }
+    if(reported == injections)
+      break;
+
+    // keep all workers busy
+    while(supervisor_running(&supervisor) < jobs && next < injections) {
+      // results of earlier campaigns are not run again
+      const CachedRun* run = cache_find_run(&cache, profile[next].key);
+      if(run) {
+        status[next] = run->status;
+        done[next] = 1;
+        cached[next] = 1;
+        next++;
+        continue;
+      }
+      // runs forked by an exploration are already done
+      if(get_exploration_status(next, &status[next], &timed_out[next])) {
+        done[next] = 1;
+        explored[next] = 1;
+        if(explored_output)
+          output[next] = explored_output[next];
+        next++;
+        continue;
+      }
+      int started = 0;
+      // sites reached before main need a fresh process
+      if(!(profile[next].flags & SITE_BEFORE_MAIN)) {
+        for(i = 0; i < server_count; i++) {
+          if(servers[i].pid && servers[i].run == -1) {
+            pid_t child = dispatch_fork_server(&servers[i], &profile[next], next, &output[next].fd);
+            // the supervisor keeps the pid to kill the run on a timeout
+            if(child > 0)
+              started = supervisor_add_fd(&supervisor, servers[i].status, child, timeout, next);
+            break;
+          }
+        }
+      }
+      if(!started) {
+        pid_t pid = start_injection(args, &profile[next], next, &heap[next], &output[next].fd);
+        if(pid == -1 || !supervisor_add_process(&supervisor, pid, timeout, next)) {
+          log("{red}Could not start injection run, aborting now{/red}");
+          exit(1);
+        }
+      }
+      next++;
+    }
+    // only explored runs became ready
+    if(!supervisor_running(&supervisor))
+      continue;
+
+    SupervisorEvent event;
+    if(!supervisor_wait(&supervisor, &event))
+      break;
+    status[event.tag] = event.status;
+    timed_out[event.tag] = event.timed_out;
+    done[event.tag] = 1;
+
+    // runs of fork servers report their status through the pipe
+    for(i = 0; i < server_count; i++) {
+      ForkServer* server = &servers[i];
+      if(event.fd == -1 || !server->pid || server->status != event.fd)
+        continue;
+      int32_t result;
+      server->run = -1;
+      if(read(server->status, &result, sizeof(result)) != sizeof(result)) {
+        log("{red}Fork server %d died{/red}", server->pid);
+        stop_fork_server(server);
+        result = SIGKILL;
+      }
+      status[event.tag] = result;
+    }
+  }
+
+  stop_fork_servers(servers, server_count);
+  supervisor_destroy(&supervisor);
+  free(servers);
+  free(status);
+  free(done);
+  free(timed_out);
+  free(explored);
+  free(cached);
+  free(heap);
+  free(output);
+  free(explored_output);
+  explored_output = NULL;
+  if(exploration_output != -1)
+    close(exploration_output);
+  exploration_output = -1;
 }
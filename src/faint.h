@@ -29,17 +29,60 @@ extern uint8_t fault_lib32[] asm("_binary_fault_inject32_so_start");
 extern uint8_t fault_lib32_end[] asm("_binary_fault_inject32_so_end");
 
 
+// default timeout of a run, relative to the duration of the profiling run
+#define TIMEOUT_FACTOR 10
+#define TIMEOUT_SLACK 1.0
+
+// outcome of an injection run
+enum RunResult {
+  RUN_EXITED, RUN_CRASHED, RUN_TIMEOUT, RUN_RESULTS
+};
+
+// captured output of a run, a part of a memory file (size -1: up to its end)
+typedef struct {
+  int fd;
+  off_t offset;
+  off_t size;
+} RunOutput;
+
+// a target stopped at main, forking a new process for every run
+typedef struct {
+  pid_t pid;
+  int control;
+  int status;
+  int run;
+} ForkServer;
+
+// length of a crash signature, the innermost frames as hex numbers
+#define BUCKET_SIGNATURE_LENGTH (CRASH_STACK_DEPTH * 17 + 1)
+
+// crashes with the same innermost frames, and all faults which caused them
+typedef struct {
+  char signature[BUCKET_SIGNATURE_LENGTH];
+  uint64_t frames[CRASH_STACK_DEPTH];
+  int depth;
+  int count;
+  cmap* faults;
+} CrashBucket;
+
 void usage(const char* binary);
 void extract_shared_library(int arch);
-int parse_profiling(size_t** addr, size_t** count, size_t** type, size_t* calls, cmap* types);
-void summary(const char* binary, int crash_count, int injections, cmap* crashes, cmap* types, size_t app_base);
-void crash_details(const char *binary, const void *crash, const void *fault, cmap *types, size_t base);
-void print_fault_position(const char* binary, const void* fault, int type, int count);
+int parse_profiling(int fd, int check_target, ProfileFile* profile, size_t* calls);
+void summary(const char* binary, int* results, int injections, cmap* crashes, const ProfileFile* sites);
+void signal_details(int run);
+int get_crash_stack(int run, uint64_t* frames);
+void add_crash(cmap* crashes, const uint64_t* frames, int depth, const void* fault);
+void destroy_crashes(cmap* crashes);
+void bucket_details(const char* binary, const CrashBucket* bucket, const ProfileFile* sites);
+void crash_details(const char *binary, const void *crash, const void *fault, const ProfileFile* sites);
+void print_fault_position(const char* binary, const ProfileEntry* site, int count);
 int parse_commandline(int argc, char* argv[]);
 void enable_default_modules();
+void open_result_cache(char* const argv[], int argc, int arch);
+int restore_cached_runs(const ProfileEntry* profile, int injections);
 void cleanup();
-int get_crash_address(void** crash, void** fault_addr);
-void clear_crash_report();
+int get_crash_address(int run, void** crash, void** fault_addr);
+void save_profile(const ProfileFile* profile);
 void list_modules();
 void disable_module(const char* m);
 void enable_module(const char* m);
@@ -48,10 +91,34 @@ void set_filename(const char* fn);
 void set_limit(int lim);
 void set_mode(enum Mode m);
 void write_settings();
+void create_control_block();
+void resize_control_block(int runs);
+void arm_sites(const ProfileEntry* profile, int injections);
+int create_memory_file(const char* name);
+int create_trace_file(const char* name);
+int inherit_fd(int fd);
+void get_fd_env(char* env, const char* name, int fd);
 void usage(const char* binary);
-int parse_heap(size_t** addr, size_t** size, size_t* blocks, size_t* total_size);
-void show_heap();
-size_t get_base_address();
+int compare_heap_events(const void* a, const void* b);
+int parse_heap(int fd, size_t** addr, size_t** size, size_t* blocks, size_t* total_size);
+void show_heap(int fd);
+void print_injection_header(const ProfileEntry* site, int run);
+void prepare_injection(const ProfileEntry* site, int run);
+pid_t start_injection(char* const args[], const ProfileEntry* site, int run, int* heap_fd, int* output_fd);
+int start_fork_server(char* const args[], ForkServer* server);
+void stop_fork_server(ForkServer* server);
+pid_t dispatch_fork_server(ForkServer* server, const ProfileEntry* site, int run, int* output_fd);
+int start_fork_servers(char* const args[], ForkServer** servers);
+void stop_fork_servers(ForkServer* servers, int count);
+void setup_child();
+void show_output(const RunOutput* output);
+int report_injection(const ProfileEntry* site, int run, int status, int timed_out, const RunOutput* output, int heap_fd,
+    cmap* crashes, const ProfileFile* sites);
+void explore_injections(char* const args[], int injections);
+void parse_exploration_output(int injections);
+int get_exploration_status(int run, int* status, char* timed_out);
+void run_injections(char* const args[], const ProfileEntry* profile, int injections, cmap* crashes, const ProfileFile* sites,
+    int* results);
 
 
 #endif /* SRC_FAINT_H_ */
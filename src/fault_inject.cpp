@@ -22,12 +22,27 @@
 
 #include "fault_inject.h"
 #include "settings.h"
-#include "map.h"
 #include "modules.h"
+#include "arena.h"
 
 #include <iostream>
 #include <string.h>
+#include <ctype.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <ucontext.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
 
 static h_malloc real_malloc = NULL;
 static h_realloc real_realloc = NULL;
@@ -40,20 +55,84 @@ static h_fwrite real_fwrite = NULL;
 static h_exit real_exit = NULL;
 static h_exit real_exit_ = NULL;
 static h_free real_free = NULL;
+static h_main real_main = NULL;
 
-static unsigned int no_intercept = 0;
+// reentrancy guard and last intercepted site, both per thread
+static __thread unsigned int no_intercept = 0;
+static __thread void* current_fault = NULL;
 
-static FaultSettings settings;
-static map_declare(faults);
-
-static map_declare(types);
+// set while the library itself needs memory, served from the private arena
+static __thread unsigned int internal = 0;
 
-static map_declare(heap);
-static map_declare(heap_location);
+static FaultSettings settings;
 
-static void* current_fault = NULL;
+// control block shared with the driver and the record of this run
+static ControlBlock* control = NULL;
+static RunRecord* record = NULL;
+// key of the site which has to fail, 0 if none is armed
+static void* armed_site = NULL;
+
+// exploration forks a run for every site at its first call, the runs still
+// going are waited for before forking more of them
+static pid_t exploration_pids[MAX_EXPLORATIONS];
+static int exploration_runs[MAX_EXPLORATIONS];
+static uint64_t exploration_deadlines[MAX_EXPLORATIONS];
+static int exploration_outputs[MAX_EXPLORATIONS];
+static int exploration_count = 0;
+// the output of every finished run is appended to the log of the driver
+static int output_fd = -1;
+static uint64_t next_reap = 0;
+static pthread_mutex_t exploration_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// call sites seen while profiling, filled without locks
+static SiteEntry sites[MAX_SITES];
+static unsigned int site_count = 0;
+
+// call counters are split into shards, threads of different shards never
+// touch the same cache line, the shards are summed up when saving
+static size_t site_counts[COUNTER_SHARDS][MAX_SITES];
+static unsigned int next_shard = 0;
+static __thread int shard = -1;
+
+// calls in the profile written last, it is only written again if it changed
+static size_t saved_profile_calls = 0;
+static int profile_saving = 0;
+
+// per-thread buffers of heap events, appended to the heap log when full
+static HeapBuffer heap_buffers[MAX_THREADS];
+static __thread HeapBuffer* heap_buffer = NULL;
+static pthread_key_t heap_buffer_key;
+static int heap_fd = -1;
+static uint64_t heap_sequence = 0;
+
+// per-thread buffers of the call trace, written as one block when full
+static CallBuffer call_buffers[MAX_THREADS];
+static __thread CallBuffer* call_buffer = NULL;
+static pthread_key_t call_buffer_key;
+static int calls_fd = -1;
+static size_t saved_sites = 0;
+
+// executable segments of the binary under test, collected once in _init
+static TextRange target_text[MAX_TEXT_RANGES];
+static int target_text_count = 0;
+
+// stack of the signal handler and the largest stack a thread may have, the
+// crash handler only follows frame pointers within a thread stack
+static char* signal_stack = NULL;
+static uintptr_t stack_limit = 0;
+// load address of the binary, sites are recorded relative to it
+static uintptr_t target_base = 0;
+static char target_build_id[PROFILE_BUILD_ID_LENGTH];
 
 static int init_done = 0;
+static int main_started = 0;
+static int valgrind = 0;
+static int stack_depth = 1;
+
+// decides for every intercepted call, chosen once for the mode of this run
+static h_handler handler = handle_uninitialized;
+static uint32_t active_modules = 0;
+static int trace_heap = 0;
 
 //-----------------------------------------------------------------------------
 void block() {
@@ -82,94 +161,137 @@ class NoIntercept {
 };
 
 //-----------------------------------------------------------------------------
-static void _init(void) {
-  block();
-
-  // read non-intercepted function handles
-  real_exit = (h_exit) dlsym(RTLD_NEXT, "exit");
-  real_exit_ = (h_exit) dlsym(RTLD_NEXT, "_exit");
-  real_free = (h_free) dlsym(RTLD_NEXT, "free");
-  if(!real_exit || !real_exit_) {
-    printf("Error getting 'exit'\n");
-  }
-  if(!real_free) {
-    printf("Error getting 'free'\n");
-  }
-
-  // read settings from file
-  FILE *f = fopen("settings", "rb");
-  if(f) {
-    fread(&settings, sizeof(FaultSettings), 1, f);
-    fclose(f);
-  }
-
-  if(!heap)
-    map_initialize(heap, MAP_GENERAL);
-  if(!heap_location)
-    map_initialize(heap_location, MAP_GENERAL);
-
-  if(settings.mode == INJECT) {
-    if(!faults)
-      map_initialize(faults, MAP_GENERAL);
-    if(!types)
-      map_initialize(types, MAP_GENERAL);
-
-    // read profile
-    f = fopen("profile", "rb");
-    if(f) {
-      int entry = 0;
-      while(!feof(f)) {
-        ProfileEntry e;
-        if(fread(&e, sizeof(ProfileEntry), 1, f) == 0)
-          break;
-        if(entry == settings.limit)
-          e.count = 1;
-        else
-          e.count = 0;
-        map(faults)->set((void*) e.address, (void*) e.count);
-        map(types)->set((void*) e.address, (void*) e.type);
-        entry++;
-      }
+class Internal {
+  private:
+  public:
+    Internal() {
+      block();
+      internal++;
     }
-    fclose(f);
-  }
-
-  // install signal handler
-  struct sigaction sig_handler;
-
-  sig_handler.sa_handler = segfault_handler;
-  sigemptyset(&sig_handler.sa_mask);
-  sig_handler.sa_flags = 0;
-  sigaction(SIGINT, &sig_handler, NULL);
-  sigaction(SIGSEGV, &sig_handler, NULL);
-  sigaction(SIGABRT, &sig_handler, NULL);
-
-  unblock();
-}
+    ~Internal() {
+      internal--;
+      unblock();
+    }
+};
 
 //-----------------------------------------------------------------------------
 template<typename T>
-void init(const char* name, T* function) {
-  NoIntercept n;
+void resolve(const char* name, T* function) {
   *function = (T) dlsym(RTLD_NEXT, name);
   if(!*function) {
     fprintf(stderr, "Error in `dlsym`: %s\n", dlerror());
     fprintf(stderr, "Cannot find function '%s'\n", name);
+  }
+}
+
+//-----------------------------------------------------------------------------
+__attribute__((constructor)) static void _init(void) {
+  // usually the first intercepted call is faster than the constructor
+  if(init_done)
     return;
+  init_done = 1;
+  Internal in;
+
+  // read non-intercepted function handles, before anything calls them
+  resolve<h_malloc>("malloc", &real_malloc);
+  resolve<h_realloc>("realloc", &real_realloc);
+  resolve<h_calloc>("calloc", &real_calloc);
+  resolve<h_fopen>("fopen", &real_fopen);
+  resolve<h_getline>("getline", &real_getline);
+  resolve<h_fgets>("fgets", &real_fgets);
+  resolve<h_fread>("fread", &real_fread);
+  resolve<h_fwrite>("fwrite", &real_fwrite);
+  resolve<h_exit>("exit", &real_exit);
+  resolve<h_exit>("_exit", &real_exit_);
+  resolve<h_free>("free", &real_free);
+
+  // settings and the armed site are read from the control block, without
+  // it (not started by the driver) every call goes to the real function
+  if(map_control()) {
+    settings = control->settings;
+    const char* run = getenv(RUN_ENV);
+    arm_run(run && isdigit((unsigned char) run[0]) ? atoi(run) : -1);
   }
 
-  if(!init_done) {
-    init_done = 1;
-    _init();
+  // number of target frames identifying an injection site
+  stack_depth = settings.stack_depth;
+  if(stack_depth < 1)
+    stack_depth = 1;
+  if(stack_depth > MAX_STACK_DEPTH)
+    stack_depth = MAX_STACK_DEPTH;
+
+  // check once whether we are running inside valgrind
+  valgrind = is_valgrind();
+
+  // every run starts with an empty heap log
+  const char* heap = getenv(HEAP_ENV);
+  if(settings.trace_heap && !valgrind && heap_fd == -1 && heap) {
+    heap_fd = atoi(heap);
+    // threads write whole buffers, without append they overwrite each other
+    if(heap_fd != -1)
+      fcntl(heap_fd, F_SETFL, fcntl(heap_fd, F_GETFL) | O_APPEND);
+    pthread_key_create(&heap_buffer_key, release_heap_buffer);
+  }
+
+  const char* output = getenv(OUTPUT_ENV);
+  if(settings.mode == EXPLORE && output_fd == -1 && output)
+    output_fd = atoi(output);
+
+  // the call trace is only recorded while profiling
+  const char* calls = getenv(CALLS_ENV);
+  if(settings.mode == PROFILE && !valgrind && calls_fd == -1 && calls && atoi(calls) != -1) {
+    calls_fd = atoi(calls);
+    pthread_key_create(&call_buffer_key, release_call_buffer);
+    pthread_atfork(NULL, NULL, reset_call_buffers);
+  }
+
+  // cache the address ranges of the binary under test
+  target_text_count = 0;
+  dl_iterate_phdr(collect_text_ranges, NULL);
+
+  // the first unwind may allocate, do it while blocked
+  get_return_address(NULL);
+
+  select_handler();
+
+  // install signal handler, on its own stack to catch stack overflows
+  struct rlimit limit;
+  if(!getrlimit(RLIMIT_STACK, &limit) && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < (uintptr_t) -1)
+    stack_limit = limit.rlim_cur;
+  else
+    stack_limit = (uintptr_t) -1;
+  if(!signal_stack) {
+    signal_stack = (char*) mmap(NULL, SIGNAL_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(signal_stack == MAP_FAILED) {
+      signal_stack = NULL;
+    } else {
+      stack_t stack;
+      stack.ss_sp = signal_stack;
+      stack.ss_size = SIGNAL_STACK_SIZE;
+      stack.ss_flags = 0;
+      sigaltstack(&stack, NULL);
+    }
   }
+
+  struct sigaction sig_handler;
+  sig_handler.sa_sigaction = segfault_handler;
+  sigemptyset(&sig_handler.sa_mask);
+  sig_handler.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigaction(SIGINT, &sig_handler, NULL);
+  sigaction(SIGSEGV, &sig_handler, NULL);
+  sigaction(SIGABRT, &sig_handler, NULL);
+  sigaction(SIGBUS, &sig_handler, NULL);
+  sigaction(SIGFPE, &sig_handler, NULL);
+  sigaction(SIGILL, &sig_handler, NULL);
 }
 
 //-----------------------------------------------------------------------------
-int module_active(const char* module) {
-  int id = get_module_id(module);
-  if(id == -1)
-    return 0;
-  return !!(settings.modules & (1 << id));
+__attribute__((destructor)) static void _fini(void) {
+  // returning from main does not go through our exit
+  wait_for_explorations(0);
+  save_profile();
+  save_heap();
+  save_calls();
 }
 
 //-----------------------------------------------------------------------------
@@ -189,164 +311,611 @@ void print_backtrace() {
 }
 
 //-----------------------------------------------------------------------------
-void* get_return_address(int index) {
-  block();
-
-  int j, nptrs;
-  void *buffer[100];
-  char **strings;
-  void* addr = NULL;
-
-  nptrs = backtrace(buffer, 100);
-  strings = backtrace_symbols(buffer, nptrs);
-  if(strings) {
-    for(j = 0; j < nptrs; j++) {
-      if(strncmp(strings[j], settings.filename, strlen(settings.filename)) == 0) {
-        if(index) {
-          //printf("skip\n");
-          index--;
-          continue;
-        }
-        addr = buffer[j];
-        break;
-      } else {
-        //printf("skip: %s\n", strings[j]);
+void read_build_id(const char* note, size_t size) {
+  // the profile is tied to the binary by the build id of the linker
+  const char* end = note + size;
+  while(note + sizeof(ElfW(Nhdr)) <= end) {
+    const ElfW(Nhdr)* header = (const ElfW(Nhdr)*) note;
+    size_t name_size = (header->n_namesz + 3) & ~3, desc_size = (header->n_descsz + 3) & ~3;
+    const unsigned char* desc = (const unsigned char*) note + sizeof(ElfW(Nhdr)) + name_size;
+    if((const char*) desc + desc_size > end)
+      return;
+    if(header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && !memcmp(note + sizeof(ElfW(Nhdr)), "GNU", 4)
+        && header->n_descsz > 0 && header->n_descsz * 2 < PROFILE_BUILD_ID_LENGTH) {
+      size_t i;
+      for(i = 0; i < header->n_descsz; i++) {
+        snprintf(target_build_id + i * 2, 3, "%02x", desc[i]);
       }
+      return;
     }
-    free(strings);
+    note = (const char*) desc + desc_size;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int collect_text_ranges(struct dl_phdr_info* info, size_t size, void* data) {
+  // the main program has an empty name, it is identified by its invocation name
+  const char* name = info->dlpi_name;
+  if(!name || !*name)
+    name = program_invocation_name;
+  if(strcmp(name, settings.filename) != 0)
+    return 0;
+
+  int i;
+  target_base = info->dlpi_addr;
+  for(i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+    if(phdr->p_type == PT_NOTE)
+      read_build_id((const char*) (info->dlpi_addr + phdr->p_vaddr), phdr->p_memsz);
+    if(phdr->p_type != PT_LOAD || !(phdr->p_flags & PF_X))
+      continue;
+    if(target_text_count == MAX_TEXT_RANGES)
+      break;
+    target_text[target_text_count].start = info->dlpi_addr + phdr->p_vaddr;
+    target_text[target_text_count].end = info->dlpi_addr + phdr->p_vaddr + phdr->p_memsz;
+    target_text_count++;
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+int is_target_address(const void* addr) {
+  int i;
+  for(i = 0; i < target_text_count; i++) {
+    if((uintptr_t) addr >= target_text[i].start && (uintptr_t) addr < target_text[i].end)
+      return 1;
   }
-  unblock();
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+_Unwind_Reason_Code collect_target_frame(struct _Unwind_Context* context, void* data) {
+  StackWalk* walk = (StackWalk*) data;
+  void* ip = (void*) _Unwind_GetIP(context);
+  if(is_target_address(ip)) {
+    walk->frames[walk->count++] = ip;
+    // stop unwinding as soon as we have enough frames
+    if(walk->count == walk->depth)
+      return _URC_END_OF_STACK;
+  }
+  return _URC_NO_REASON;
+}
+
+//-----------------------------------------------------------------------------
+int get_target_stack(void* caller, void** frames, int depth) {
+  // fast path: the intercepted function was called directly by the target
+  if(depth == 1 && caller && is_target_address(caller)) {
+    frames[0] = (void*) ((uintptr_t) caller - target_base);
+    return 1;
+  }
+
+  // otherwise, unwind until we have the innermost frames inside the target
+  StackWalk walk;
+  walk.frames = frames;
+  walk.depth = depth;
+  walk.count = 0;
+  _Unwind_Backtrace(collect_target_frame, &walk);
+
+  // frames are addresses in the binary, independent of where it was loaded
+  int i;
+  for(i = 0; i < walk.count; i++) {
+    frames[i] = (void*) ((uintptr_t) frames[i] - target_base);
+  }
+  return walk.count;
+}
+
+//-----------------------------------------------------------------------------
+void* get_return_address(void* caller) {
+  void* addr = NULL;
+  if(!get_target_stack(caller, &addr, 1))
+    return NULL;
   return addr;
 }
 
 //-----------------------------------------------------------------------------
-void save_trace(const char* type) {
+void* get_site_key(void** frames, int depth) {
+  // a single frame is its own key, otherwise the frames are hashed
+  if(depth == 1)
+    return frames[0];
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  int i;
+  for(i = 0; i < depth; i++) {
+    hash = (hash ^ (uint64_t) (uintptr_t) frames[i]) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+  }
+  uintptr_t key = (uintptr_t) hash;
+  return (void*) (key ? key : 1);
+}
+
+//-----------------------------------------------------------------------------
+SiteEntry* save_trace(size_t module, void* key, void** frames, int depth) {
   if(!no_intercept) {
-    printf("Error locking tracing! (%s)\n", type);
-    return;
+    printf("Error locking tracing! (%s)\n", get_module(module));
+    return NULL;
   }
-  void* caller = get_return_address(0);
 
-  Dl_info info;
-  if(dladdr(caller, &info)) {
-    if(info.dli_fname && strcmp(info.dli_fname, settings.filename) != 0) {
-      // not our file
-      return;
+  SiteEntry* site = get_site(key, module, frames, depth);
+  if(!site)
+    return NULL;
+  // a fork server cannot inject faults before main
+  if(!main_started && !(site->flags & SITE_BEFORE_MAIN))
+    __atomic_fetch_or(&site->flags, SITE_BEFORE_MAIN, __ATOMIC_RELAXED);
+  if(shard == -1)
+    shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % COUNTER_SHARDS;
+  __atomic_fetch_add(&site_counts[shard][site - sites], 1, __ATOMIC_RELAXED);
+  return site;
+}
+
+//-----------------------------------------------------------------------------
+SiteEntry* get_site(void* key, size_t type, void** frames, int depth) {
+  // open addressing, a slot is claimed by atomically setting its key
+  size_t i, pos = site_hash(key);
+  for(i = 0; i < MAX_SITES; i++) {
+    SiteEntry* site = &sites[(pos + i) & (MAX_SITES - 1)];
+    void* current = __atomic_load_n(&site->key, __ATOMIC_ACQUIRE);
+    if(current == NULL) {
+      if(__atomic_compare_exchange_n(&site->key, &current, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        site->type = type;
+        site->depth = depth;
+        memcpy(site->stack, frames, depth * sizeof(void*));
+        // ids follow the order of the first hit, zero until published
+        __atomic_store_n(&site->id, __atomic_add_fetch(&site_count, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+        return site;
+      }
     }
+    // either already there, or another thread claimed the slot first
+    if(current == key)
+      return site;
   }
+  // table is full
+  return NULL;
+}
 
-  if(!faults)
-    map_initialize(faults, MAP_GENERAL);
-  if(!types)
-    map_initialize(types, MAP_GENERAL);
+//-----------------------------------------------------------------------------
+size_t get_site_id(SiteEntry* site) {
+  // a thread which just claimed the slot may not have published the id yet
+  unsigned int id;
+  while(!(id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE)))
+    ;
+  return id - 1;
+}
 
-  if(map(faults)->has(caller)) {
-    map(faults)->set(caller, (void*) ((size_t) (map(faults)->get(caller)) + 1));
-  } else {
-    map(faults)->set(caller, (void*) 1);
+//-----------------------------------------------------------------------------
+void save_profile() {
+  // the profile is only written when the program terminates
+  if(settings.mode != PROFILE || !__atomic_load_n(&site_count, __ATOMIC_RELAXED))
+    return;
+  Internal in;
+
+  // exit, _exit, the crash handler and the destructor all get here, every new
+  // site and call raises the total
+  size_t i, j, calls = 0;
+  for(j = 0; j < COUNTER_SHARDS; j++) {
+    for(i = 0; i < MAX_SITES; i++) {
+      calls += __atomic_load_n(&site_counts[j][i], __ATOMIC_RELAXED);
+    }
   }
-  map(types)->set(caller, (void*) get_module_id(type));
+  if(calls == saved_profile_calls || __atomic_exchange_n(&profile_saving, 1, __ATOMIC_ACQUIRE))
+    return;
 
-  FILE* f = fopen("profile", "wb");
-  cmap_iterator* it = map(faults)->iterator();
-  while(!map_iterator(it)->end()) {
-    void* k = map_iterator(it)->key();
-    void* v = map_iterator(it)->value();
+  // header, module table, sites and strings in one buffer, see ProfileHeader
+  size_t count = 0, modules = get_module_count(), strings = 0;
+  for(i = 0; i < modules; i++) {
+    strings += strlen(get_module(i)) + 1;
+  }
+  size_t module_offset = sizeof(ProfileHeader);
+  size_t site_offset = (module_offset + modules * sizeof(uint32_t) + 7) & ~(size_t) 7;
+  size_t capacity = site_offset + MAX_SITES * sizeof(ProfileEntry) + strings;
+  char* data = (char*) map_buffer(capacity);
+  if(!data) {
+    __atomic_store_n(&profile_saving, 0, __ATOMIC_RELEASE);
+    return;
+  }
+  memset(data, 0, site_offset);
+
+  // sites are collected first, the profile is written sorted by key
+  ProfileEntry* entries = (ProfileEntry*) (data + site_offset);
+  for(i = 0; i < MAX_SITES; i++) {
+    void* key = __atomic_load_n(&sites[i].key, __ATOMIC_ACQUIRE);
+    if(!key)
+      continue;
     ProfileEntry e;
-    e.address = (uint64_t) k;
-    e.count = (uint64_t) v;
-    e.type = (uint64_t) map(types)->get(k);
+    memset(&e, 0, sizeof(ProfileEntry));
+    e.key = (uint64_t) (uintptr_t) key;
+    e.address = (uint64_t) (uintptr_t) sites[i].stack[0];
+    e.depth = sites[i].depth;
+    for(j = 0; j < e.depth; j++) {
+      e.stack[j] = (uint64_t) (uintptr_t) sites[i].stack[j];
+    }
+    e.count = 0;
+    for(j = 0; j < COUNTER_SHARDS; j++) {
+      e.count += __atomic_load_n(&site_counts[j][i], __ATOMIC_RELAXED);
+    }
+    e.type = (uint64_t) sites[i].type;
+    e.flags = __atomic_load_n(&sites[i].flags, __ATOMIC_RELAXED);
+    entries[count++] = e;
+  }
+  sort_profile_entries(entries, count);
+
+  // the strings directly follow the sites
+  size_t string_offset = site_offset + count * sizeof(ProfileEntry), string_pos = 0;
+  uint32_t* module_table = (uint32_t*) (data + module_offset);
+  for(i = 0; i < modules; i++) {
+    module_table[i] = string_pos;
+    strcpy(data + string_offset + string_pos, get_module(i));
+    string_pos += strlen(get_module(i)) + 1;
+  }
 
-    fwrite(&e, sizeof(ProfileEntry), 1, f);
-    map_iterator(it)->next();
+  ProfileHeader* header = (ProfileHeader*) data;
+  header->magic = PROFILE_MAGIC;
+  header->version = PROFILE_VERSION;
+  header->entry_size = sizeof(ProfileEntry);
+  header->module_count = modules;
+  header->site_count = count;
+  header->module_offset = module_offset;
+  header->site_offset = site_offset;
+  header->string_offset = string_offset;
+  header->string_size = strings;
+  memcpy(header->build_id, target_build_id, PROFILE_BUILD_ID_LENGTH);
+
+  // the driver passes a memory file for the profile, it is replaced as a whole
+  const char* fd = getenv(PROFILE_ENV);
+  if(fd && !ftruncate(atoi(fd), 0)) {
+    size_t size = string_offset + strings, done = 0;
+    while(done < size) {
+      ssize_t n = pwrite(atoi(fd), data + done, size - done, done);
+      if(n <= 0)
+        break;
+      done += n;
+    }
+    if(done == size)
+      saved_profile_calls = calls;
   }
-  map_iterator(it)->destroy();
-  fclose(f);
+  munmap(data, capacity);
+  __atomic_store_n(&profile_saving, 0, __ATOMIC_RELEASE);
 }
 
 //-----------------------------------------------------------------------------
-int is_valgrind() {
-  block();
+static void sift_profile_entry(ProfileEntry* entries, size_t pos, size_t count) {
+  while(2 * pos + 1 < count) {
+    size_t child = 2 * pos + 1;
+    if(child + 1 < count && entries[child + 1].key > entries[child].key)
+      child++;
+    if(entries[pos].key >= entries[child].key)
+      return;
+    ProfileEntry tmp = entries[pos];
+    entries[pos] = entries[child];
+    entries[child] = tmp;
+    pos = child;
+  }
+}
 
-  int j, nptrs, val = 0;
-  void *buffer[100];
-  char **strings;
+//-----------------------------------------------------------------------------
+void sort_profile_entries(ProfileEntry* entries, size_t count) {
+  // heap sort by key, qsort may allocate and the crash handler must not
+  size_t i;
+  for(i = count / 2; i > 0; i--) {
+    sift_profile_entry(entries, i - 1, count);
+  }
+  for(i = count; i > 1; i--) {
+    ProfileEntry tmp = entries[0];
+    entries[0] = entries[i - 1];
+    entries[i - 1] = tmp;
+    sift_profile_entry(entries, 0, i - 1);
+  }
+}
 
-  nptrs = backtrace(buffer, 100);
-  strings = backtrace_symbols(buffer, nptrs);
-  if(strings) {
-    for(j = 0; j < nptrs; j++) {
-      if(strncmp(strings[j], settings.filename, strlen(settings.filename)) == 0) {
-        break;
-      }
-      if(strncmp(strings[j], "/usr/bin/valgrind", strlen("/usr/bin/valgrind")) == 0) {
-        val = 1;
-        break;
-      }
-    }
-    free(strings);
+//-----------------------------------------------------------------------------
+void arm_run(int run) {
+  settings.limit = run;
+  if(!control)
+    return;
+  // processes which are no injection run use slot 0, which has nothing armed
+  if(run >= 0 && (uint32_t) run < control->runs)
+    record = CONTROL_RECORD(control, RUN_SLOT(run));
+  else
+    record = CONTROL_RECORD(control, 0);
+  armed_site = (void*) (uintptr_t) record->armed;
+}
+
+//-----------------------------------------------------------------------------
+int map_control() {
+  const char* fd = getenv(CONTROL_ENV);
+  if(!fd)
+    return 0;
+  struct stat st;
+  if(fstat(atoi(fd), &st) || st.st_size < (off_t) CONTROL_SIZE(0))
+    return 0;
+  void* mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, atoi(fd), 0);
+  if(mem == MAP_FAILED)
+    return 0;
+
+  // a driver of a different version might use another layout
+  ControlBlock* block = (ControlBlock*) mem;
+  if(block->magic != CONTROL_MAGIC || block->version != CONTROL_VERSION
+      || CONTROL_SIZE(block->runs) > (size_t) st.st_size) {
+    munmap(mem, st.st_size);
+    return 0;
   }
-  unblock();
-  return val;
+  control = block;
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
-template<typename T>
-int handle_inject(const char* name, T* function, const char* tracename) {
-  if(*function == NULL) {
+int is_valgrind() {
+  // the valgrind launcher is started with the preloaded library as well, its
+  // own allocations must never be intercepted, a target may be named alike
+  const char* name = strrchr(program_invocation_name, '/');
+  name = name ? name + 1 : program_invocation_name;
+  return !strcmp(name, "valgrind") || !strcmp(name, "valgrind.bin");
+}
+
+//-----------------------------------------------------------------------------
+template<enum Mode M, bool TraceHeap, bool TraceCalls>
+int handle_site(size_t module, void** site, size_t size) {
+  if(!(active_modules & (1 << module)) || no_intercept)
+    return REAL;
+
+  void* frames[MAX_STACK_DEPTH];
+  int depth = get_target_stack(*site, frames, stack_depth);
+  if(!depth) {
+    // not called from our file
+    current_fault = NULL;
+    return REAL;
+  }
+  void* key = get_site_key(frames, depth);
+  *site = frames[0];
+  current_fault = key;
+
+  if(M == PROFILE) {
+    NoIntercept n;
+    SiteEntry* entry = save_trace(module, key, frames, depth);
+    if(TraceCalls && entry)
+      log_call(get_site_id(entry), size);
+  } else if(M == INJECT && key == armed_site) {
+    // only the armed site fails, every other call goes to the real function
+    __atomic_fetch_add(&record->injected, 1, __ATOMIC_RELAXED);
+    return FAIL;
+  } else if(M == EXPLORE) {
     NoIntercept n;
-    init<T>(name, function);
+    return explore_site(key);
   }
+  return TraceHeap ? TRACE : WRAP;
+}
+
+//-----------------------------------------------------------------------------
+int handle_passthrough(size_t module, void** site, size_t size) {
+  return REAL;
+}
 
-  if(!module_active(name) || no_intercept || is_valgrind()) {
+//-----------------------------------------------------------------------------
+int handle_uninitialized(size_t module, void** site, size_t size) {
+  // intercepted before the constructor ran
+  _init();
+  if(handler == handle_uninitialized)
     return REAL;
+  return handler(module, site, size);
+}
+
+//-----------------------------------------------------------------------------
+void select_handler() {
+  // valgrind itself and runs without modules never need to look at a call
+  if(valgrind || !settings.modules) {
+    handler = handle_passthrough;
+    return;
+  }
+  active_modules = settings.modules;
+  trace_heap = settings.trace_heap;
+
+  if(settings.mode == PROFILE && calls_fd != -1)
+    handler = trace_heap ? handle_site<PROFILE, true, true> : handle_site<PROFILE, false, true>;
+  else if(settings.mode == PROFILE)
+    handler = trace_heap ? handle_site<PROFILE, true, false> : handle_site<PROFILE, false, false>;
+  else if(settings.mode == INJECT)
+    handler = trace_heap ? handle_site<INJECT, true, false> : handle_site<INJECT, false, false>;
+  else if(settings.mode == EXPLORE && control)
+    handler = handle_site<EXPLORE, false, false>;
+  else
+    handler = handle_passthrough;
+}
+
+//-----------------------------------------------------------------------------
+ssize_t find_run(void* key) {
+  // runs are in the order of the profile, which is sorted by key
+  size_t low = 0, high = control->runs;
+  uint64_t k = (uint64_t) (uintptr_t) key;
+  while(low < high) {
+    size_t mid = low + (high - low) / 2;
+    if(CONTROL_RECORD(control, RUN_SLOT(mid))->armed < k)
+      low = mid + 1;
+    else
+      high = mid;
   }
+  if(low < control->runs && CONTROL_RECORD(control, RUN_SLOT(low))->armed == k)
+    return low;
+  return -1;
+}
 
-  void* addr = get_return_address(0);
-  current_fault = addr;
+//-----------------------------------------------------------------------------
+int get_thread_count() {
+  // field 20 of /proc/self/stat, the name before it may contain anything
+  char stat[1024];
+  int fd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+  if(fd == -1)
+    return -1;
+  ssize_t size = read(fd, stat, sizeof(stat) - 1);
+  close(fd);
+  if(size <= 0)
+    return -1;
+  stat[size] = 0;
+  char* pos = strrchr(stat, ')');
+  int field;
+  for(field = 2; pos && field < 20; field++) {
+    pos = strchr(pos + 1, ' ');
+  }
+  return pos ? atoi(pos + 1) : -1;
+}
 
-  if(settings.mode == PROFILE) {
-    NoIntercept n;
-    save_trace(tracename);
+//-----------------------------------------------------------------------------
+int explore_site(void* key) {
+  // results are saved as soon as runs finish, not only when forking more
+  if(__atomic_load_n(&exploration_count, __ATOMIC_RELAXED)
+      && get_timestamp() > __atomic_load_n(&next_reap, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&exploration_lock);
+    reap_explorations();
+    pthread_mutex_unlock(&exploration_lock);
+  }
+
+  ssize_t run = find_run(key);
+  uint32_t* explored = run < 0 ? NULL : &CONTROL_RECORD(control, RUN_SLOT(run))->explored;
+  if(!explored || __atomic_load_n(explored, __ATOMIC_ACQUIRE) != EXPLORE_NONE)
     return WRAP;
-  } else if(settings.mode == INJECT) {
-    if(!addr)
-      return REAL;
-    if(!map(faults)->has(addr)) {
-      printf("strange, %p was not profiled\n", addr);
-      return REAL;
-    } else {
-      if(map(faults)->get(addr)) {
-        // let it fail
-        return FAIL;
-      } else {
-        // real function
-        return WRAP;
-      }
+  // the child keeps only the forking thread, the other threads would be missing
+  uint32_t state = EXPLORE_NONE;
+  if(get_thread_count() != 1) {
+    __atomic_compare_exchange_n(explored, &state, EXPLORE_SKIPPED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return WRAP;
+  }
+  if(!__atomic_compare_exchange_n(explored, &state, EXPLORE_FORKED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return WRAP;
+
+  pthread_mutex_lock(&exploration_lock);
+  int limit = settings.jobs < 1 ? 1 : settings.jobs;
+  wait_for_explorations((limit < MAX_EXPLORATIONS ? limit : MAX_EXPLORATIONS) - 1);
+  // a memory file of its own, the runs may finish in any order
+  int output = output_fd != -1 ? memfd_create("faint-output", MFD_CLOEXEC) : -1;
+  pid_t pid = fork();
+  if(pid == 0) {
+    // the child is now injection run #run, it never forks again
+    exploration_count = 0;
+    pthread_mutex_init(&exploration_lock, NULL);
+    // a group of its own, a timeout kills everything the run started
+    setpgid(0, 0);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if(output != -1) {
+      dup2(output, STDOUT_FILENO);
+      dup2(output, STDERR_FILENO);
+      close(output);
     }
+    if(output_fd != -1)
+      close(output_fd);
+    output_fd = -1;
+    settings.mode = INJECT;
+    arm_run(run);
+    handler = handle_site<INJECT, false, false>;
+    __atomic_fetch_add(&record->injected, 1, __ATOMIC_RELAXED);
+    return FAIL;
   }
-  // don't know what to do
-  return REAL;
+  if(pid > 0) {
+    setpgid(pid, pid);
+    exploration_pids[exploration_count] = pid;
+    exploration_runs[exploration_count] = run;
+    exploration_deadlines[exploration_count] = settings.timeout > 0 ? get_timestamp() + settings.timeout * 1e9 : 0;
+    exploration_outputs[exploration_count] = output;
+    exploration_count++;
+  } else if(output != -1) {
+    close(output);
+  }
+  pthread_mutex_unlock(&exploration_lock);
+  // the parent goes on with the real call
+  return WRAP;
 }
 
 //-----------------------------------------------------------------------------
-template<typename T>
-int handle_inject(const char* name, T* function) {
-  return handle_inject(name, function, name);
+void wait_for_explorations(int limit) {
+  // whichever run finishes first makes room, the result of every run is left
+  // for the driver
+  reap_explorations();
+  while(exploration_count > limit) {
+    struct timespec pause = { 0, EXPLORATION_POLL };
+    nanosleep(&pause, NULL);
+    reap_explorations();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void reap_explorations() {
+  uint64_t now = get_timestamp();
+  __atomic_store_n(&next_reap, now + EXPLORATION_POLL, __ATOMIC_RELAXED);
+  int i = 0;
+  while(i < exploration_count) {
+    int status = 0, timed_out = 0;
+    pid_t pid = exploration_pids[i], done = waitpid(pid, &status, WNOHANG);
+    if(!done && exploration_deadlines[i] && now > exploration_deadlines[i]) {
+      // the run and everything it started
+      kill(-pid, SIGKILL);
+      kill(pid, SIGKILL);
+      while((done = waitpid(pid, &status, 0)) == -1 && errno == EINTR)
+        ;
+      timed_out = 1;
+    }
+    if(!done) {
+      i++;
+      continue;
+    }
+    // a run reaped by the target itself is left to the driver to repeat
+    if(done == pid) {
+      save_exploration_output(exploration_runs[i], exploration_outputs[i]);
+      save_exploration(exploration_runs[i], status, timed_out);
+    }
+    if(exploration_outputs[i] != -1)
+      close(exploration_outputs[i]);
+    exploration_count--;
+    exploration_pids[i] = exploration_pids[exploration_count];
+    exploration_runs[i] = exploration_runs[exploration_count];
+    exploration_deadlines[i] = exploration_deadlines[exploration_count];
+    exploration_outputs[i] = exploration_outputs[exploration_count];
+  }
+}
+
+//-----------------------------------------------------------------------------
+void save_exploration_output(int run, int fd) {
+  struct stat st;
+  if(output_fd == -1 || fd == -1 || fstat(fd, &st))
+    return;
+  // only the exploration writes to the log, records are never interleaved
+  OutputRecord header = { run, 0, (uint64_t) st.st_size };
+  write_all(output_fd, &header, sizeof(header));
+  char buffer[4096];
+  off_t pos = 0;
+  ssize_t n;
+  while(pos < st.st_size && (n = pread(fd, buffer, sizeof(buffer), pos)) > 0) {
+    write_all(output_fd, buffer, n);
+    pos += n;
+  }
+  // the output shrank meanwhile, keep the size of the record
+  memset(buffer, 0, sizeof(buffer));
+  while(pos < st.st_size) {
+    n = st.st_size - pos < (off_t) sizeof(buffer) ? st.st_size - pos : sizeof(buffer);
+    write_all(output_fd, buffer, n);
+    pos += n;
+  }
+}
+
+//-----------------------------------------------------------------------------
+void save_exploration(int run, int status, int timed_out) {
+  // the status has to be visible before the run is marked as done
+  RunRecord* r = CONTROL_RECORD(control, RUN_SLOT(run));
+  r->status = status;
+  r->timed_out = timed_out;
+  __atomic_store_n(&r->explored, EXPLORE_DONE, __ATOMIC_RELEASE);
 }
 
 //-----------------------------------------------------------------------------
 void *malloc(size_t size) {
+  void* addr;
+  if(internal && (addr = arena_alloc(size)))
+    return addr;
+
   int res;
-  if((res = handle_inject<h_malloc>("malloc", &real_malloc)) == FAIL) {
+  void* site = __builtin_return_address(0);
+  if((res = handler(MODULE_MALLOC, &site, size)) == FAIL) {
     return NULL;
   } else {
     NoIntercept n;
-    void* addr = real_malloc(size);
-    if(res == WRAP && settings.trace_heap && get_return_address(0)) {
-      map(heap)->set(addr, (void*) size);
-      map(heap_location)->set(addr, get_return_address(0));
-      save_heap();
+    addr = real_malloc(size);
+    if(res == TRACE && addr) {
+      log_heap_event(HEAP_ALLOC, addr, site, size);
     }
     return addr;
   }
@@ -354,18 +923,27 @@ void *malloc(size_t size) {
 
 //-----------------------------------------------------------------------------
 void *realloc(void* mem, size_t size) {
+  void* addr;
+  if(arena_contains(mem))
+    return arena_realloc(mem, size);
+  if(internal && !mem && (addr = arena_alloc(size)))
+    return addr;
+
   int res;
-  if((res = handle_inject<h_realloc>("realloc", &real_realloc)) == FAIL) {
+  void* site = __builtin_return_address(0);
+  if((res = handler(MODULE_REALLOC, &site, size)) == FAIL) {
     return NULL;
   } else {
     NoIntercept n;
-    void* addr = real_realloc(mem, size);
-    if(res == WRAP && settings.trace_heap && get_return_address(0)) {
-      map(heap)->unset(mem);
-      map(heap_location)->unset(mem);
-      map(heap)->set(addr, (void*) size);
-      map(heap_location)->set(addr, get_return_address(0));
-      save_heap();
+    // another thread may get the old block as soon as realloc returns
+    uint64_t sequence = res == TRACE ? next_heap_sequence() : 0;
+    addr = real_realloc(mem, size);
+    if(res == TRACE) {
+      // the old block is gone if realloc succeeded or was used as free
+      if(mem && (addr || !size))
+        log_heap_event(HEAP_FREE, mem, NULL, 0, sequence);
+      if(addr)
+        log_heap_event(HEAP_ALLOC, addr, site, size);
     }
     return addr;
   }
@@ -373,16 +951,19 @@ void *realloc(void* mem, size_t size) {
 
 //-----------------------------------------------------------------------------
 void *calloc(size_t elem, size_t size) {
+  void* addr;
+  if(internal && (addr = arena_calloc(elem, size)))
+    return addr;
+
   int res;
-  if((res = handle_inject<h_calloc>("calloc", &real_calloc)) == FAIL) {
+  void* site = __builtin_return_address(0);
+  if((res = handler(MODULE_CALLOC, &site, elem * size)) == FAIL) {
     return NULL;
   } else {
     NoIntercept n;
-    void* addr = real_calloc(elem, size);
-    if(res == WRAP && settings.trace_heap && get_return_address(0)) {
-      map(heap)->set(addr, (void*) size);
-      map(heap_location)->set(addr, get_return_address(0));
-      save_heap();
+    addr = real_calloc(elem, size);
+    if(res == TRACE && addr) {
+      log_heap_event(HEAP_ALLOC, addr, site, elem * size);
     }
     return addr;
   }
@@ -390,17 +971,20 @@ void *calloc(size_t elem, size_t size) {
 
 //-----------------------------------------------------------------------------
 void* operator new(size_t size) {
+  void* addr;
+  if(internal && (addr = arena_alloc(size)))
+    return addr;
+
   int res;
-  if((res = handle_inject<h_malloc>("malloc", &real_malloc, "new")) == FAIL) {
+  void* site = __builtin_return_address(0);
+  if((res = handler(MODULE_NEW, &site, size)) == FAIL) {
     throw std::bad_alloc();
     return NULL;
   } else {
     NoIntercept n;
-    void* addr = real_malloc(size);
-    if(res == WRAP && settings.trace_heap && get_return_address(0)) {
-      map(heap)->set(addr, (void*) size);
-      map(heap_location)->set(addr, get_return_address(0));
-      save_heap();
+    addr = real_malloc(size);
+    if(res == TRACE && addr) {
+      log_heap_event(HEAP_ALLOC, addr, site, size);
     }
     return addr;
   }
@@ -408,43 +992,44 @@ void* operator new(size_t size) {
 
 //-----------------------------------------------------------------------------
 void free(void* addr) {
+  if(arena_contains(addr))
+    return arena_free(addr);
   if(!real_free)
     _init();
 
-  if(no_intercept || is_valgrind())
+  if(!trace_heap || no_intercept)
     return real_free(addr);
   else {
     NoIntercept n;
-    if(settings.trace_heap && get_return_address(0)) {
-      map(heap)->unset(addr);
-      map(heap_location)->unset(addr);
-      save_heap();
-    }
+    // blocks not allocated by the target are ignored when replaying the log
+    if(addr)
+      log_heap_event(HEAP_FREE, addr, NULL, 0);
     return real_free(addr);
   }
 }
 
 //-----------------------------------------------------------------------------
 void operator delete(void* addr) {
+  if(arena_contains(addr))
+    return arena_free(addr);
   if(!real_free)
     _init();
 
-  if(no_intercept || is_valgrind())
+  if(!trace_heap || no_intercept)
     return real_free(addr);
   else {
     NoIntercept n;
-    if(settings.trace_heap && get_return_address(0)) {
-      map(heap)->unset(addr);
-      map(heap_location)->unset(addr);
-      save_heap();
-    }
+    // blocks not allocated by the target are ignored when replaying the log
+    if(addr)
+      log_heap_event(HEAP_FREE, addr, NULL, 0);
     return real_free(addr);
   }
 }
 
 //-----------------------------------------------------------------------------
 FILE *fopen(const char* name, const char* mode) {
-  if(!handle_inject<h_fopen>("fopen", &real_fopen)) {
+  void* site = __builtin_return_address(0);
+  if(handler(MODULE_FOPEN, &site, 0) == FAIL) {
     return NULL;
   } else {
     NoIntercept n;
@@ -454,7 +1039,8 @@ FILE *fopen(const char* name, const char* mode) {
 
 //-----------------------------------------------------------------------------
 ssize_t getline(char** lineptr, size_t* len, FILE* stream) {
-  if(!handle_inject<h_getline>("getline", &real_getline)) {
+  void* site = __builtin_return_address(0);
+  if(handler(MODULE_GETLINE, &site, 0) == FAIL) {
     return -1;
   } else {
     NoIntercept n;
@@ -464,7 +1050,8 @@ ssize_t getline(char** lineptr, size_t* len, FILE* stream) {
 
 //-----------------------------------------------------------------------------
 char* fgets(char* buffer, int size, FILE* f) {
-  if(!handle_inject<h_fgets>("fgets", &real_fgets)) {
+  void* site = __builtin_return_address(0);
+  if(handler(MODULE_FGETS, &site, size) == FAIL) {
     return NULL;
   } else {
     NoIntercept n;
@@ -474,7 +1061,8 @@ char* fgets(char* buffer, int size, FILE* f) {
 
 //-----------------------------------------------------------------------------
 size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  if(!handle_inject<h_fread>("fread", &real_fread)) {
+  void* site = __builtin_return_address(0);
+  if(handler(MODULE_FREAD, &site, size * nmemb) == FAIL) {
     return 0;
   } else {
     NoIntercept n;
@@ -484,7 +1072,8 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
 
 //-----------------------------------------------------------------------------
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  if(!handle_inject<h_fwrite>("fwrite", &real_fwrite)) {
+  void* site = __builtin_return_address(0);
+  if(handler(MODULE_FWRITE, &site, size * nmemb) == FAIL) {
     return 0;
   } else {
     NoIntercept n;
@@ -492,13 +1081,105 @@ size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
   }
 }
 
+//-----------------------------------------------------------------------------
+extern "C" int __libc_start_main(h_main main, int argc, char** argv, void (*init)(void), void (*fini)(void),
+    void (*rtld_fini)(void), void* stack_end) {
+  h_libc_start_main real_start = (h_libc_start_main) dlsym(RTLD_NEXT, "__libc_start_main");
+  real_main = main;
+  return real_start(start_main, argc, argv, init, fini, rtld_fini, stack_end);
+}
+
+//-----------------------------------------------------------------------------
+int start_main(int argc, char** argv, char** envp) {
+  main_started = 1;
+  const char* channel = getenv(FORK_SERVER_ENV);
+  if(channel)
+    run_fork_server(channel);
+  return real_main(argc, argv, envp);
+}
+
+//-----------------------------------------------------------------------------
+int receive_fork_request(int control, ForkRequest* request, int* output) {
+  struct iovec data = { request, sizeof(ForkRequest) };
+  char buffer[CMSG_SPACE(sizeof(int))];
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = buffer;
+  message.msg_controllen = sizeof(buffer);
+  *output = -1;
+  if(recvmsg(control, &message, MSG_CMSG_CLOEXEC) != sizeof(ForkRequest))
+    return 0;
+  // the file the run writes its output to, if the driver sent one
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if(request->capture_output && header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+    memcpy(output, CMSG_DATA(header), sizeof(int));
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+void run_fork_server(const char* channel) {
+  int control, status;
+  if(sscanf(channel, "%d,%d", &control, &status) != 2)
+    return;
+  // programs started by the target must not become fork servers
+  unsetenv(FORK_SERVER_ENV);
+  if(!init_done)
+    _init();
+
+  // tell the driver that we reached main
+  int32_t message = 0;
+  if(write(status, &message, sizeof(message)) != sizeof(message))
+    real_exit_(1);
+
+  ForkRequest request;
+  int output;
+  while(receive_fork_request(control, &request, &output)) {
+    pid_t pid = fork();
+    if(pid == 0) {
+      // the run continues with main, only with its own site armed
+      close(control);
+      close(status);
+      // like a run started by the driver, its own group for timeouts
+      setpgid(0, 0);
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+      arm_run(request.run);
+      if(output != -1) {
+        dup2(output, STDOUT_FILENO);
+        dup2(output, STDERR_FILENO);
+        close(output);
+      }
+      return;
+    }
+    if(output != -1)
+      close(output);
+
+    // the pid comes first, -1 if the run could not be forked
+    message = pid;
+    if(write(status, &message, sizeof(message)) != sizeof(message))
+      break;
+    if(pid < 0)
+      continue;
+    int result = 0;
+    waitpid(pid, &result, 0);
+    message = result;
+    if(write(status, &message, sizeof(message)) != sizeof(message))
+      break;
+  }
+  // driver is done with us
+  real_exit_(0);
+}
+
 //-----------------------------------------------------------------------------
 void exit(int status) {
   if(!real_exit)
     _init();
 
-  if(settings.trace_heap)
-    save_heap();
+  wait_for_explorations(0);
+  save_profile();
+  save_heap();
+  save_calls();
   real_exit(status);
   while(1) {
     // to prevent gcc warning
@@ -510,46 +1191,475 @@ void _exit(int status) {
   if(!real_exit_)
     _init();
 
-  if(settings.trace_heap)
-    save_heap();
+  wait_for_explorations(0);
+  save_profile();
+  save_heap();
+  save_calls();
   real_exit_(status);
   while(1) {
     // to prevent gcc warning
   }
 }
 
+//-----------------------------------------------------------------------------
+HeapBuffer* get_heap_buffer() {
+  if(heap_buffer)
+    return heap_buffer;
+
+  // claim a free buffer for this thread, it is released when the thread exits
+  int i;
+  for(i = 0; i < MAX_THREADS; i++) {
+    int expected = 0;
+    if(__atomic_compare_exchange_n(&heap_buffers[i].used, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      heap_buffer = &heap_buffers[i];
+      heap_buffer->count = 0;
+      pthread_setspecific(heap_buffer_key, heap_buffer);
+      return heap_buffer;
+    }
+  }
+  return NULL;
+}
+
+//-----------------------------------------------------------------------------
+void release_heap_buffer(void* buffer) {
+  Internal in;
+  HeapBuffer* b = (HeapBuffer*) buffer;
+  flush_heap_buffer(b);
+  heap_buffer = NULL;
+  __atomic_store_n(&b->used, 0, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+void write_heap_events(const HeapEvent* events, int count) {
+  // the log is append-only, a single write is never interleaved with others
+  write_all(heap_fd, events, count * sizeof(HeapEvent));
+}
+
+//-----------------------------------------------------------------------------
+void* map_buffer(size_t size) {
+  // not from the arena, the crash handler may run while this thread holds its lock
+  void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return data == MAP_FAILED ? NULL : data;
+}
+
+//-----------------------------------------------------------------------------
+void write_all(int fd, const void* data, size_t len) {
+  const char* pos = (const char*) data;
+  while(len) {
+    ssize_t written = write(fd, pos, len);
+    if(written <= 0) {
+      if(written == -1 && errno == EINTR)
+        continue;
+      break;
+    }
+    pos += written;
+    len -= written;
+  }
+}
+
+//-----------------------------------------------------------------------------
+void flush_heap_buffer(HeapBuffer* buffer) {
+  if(buffer->count == 0)
+    return;
+  write_heap_events(buffer->events, buffer->count);
+  buffer->count = 0;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t next_heap_sequence() {
+  return __atomic_add_fetch(&heap_sequence, 1, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+void log_heap_event(uint8_t type, void* block, void* site, size_t size, uint64_t sequence) {
+  if(heap_fd == -1)
+    return;
+
+  // frees are logged before the block is released, allocations after they
+  // got it, so the sequence of a reused block is always in order
+  HeapEvent event;
+  event.sequence = sequence ? sequence : next_heap_sequence();
+  event.type = type;
+  event.block = (uint64_t) block;
+  event.address = (uint64_t) site;
+  event.size = (uint64_t) size;
+
+  HeapBuffer* buffer = get_heap_buffer();
+  if(!buffer) {
+    // more threads than buffers, write directly
+    write_heap_events(&event, 1);
+    return;
+  }
+  buffer->events[buffer->count++] = event;
+  if(buffer->count == HEAP_BUFFER_EVENTS)
+    flush_heap_buffer(buffer);
+}
+
 //-----------------------------------------------------------------------------
 void save_heap() {
-  NoIntercept n;
+  if(heap_fd == -1)
+    return;
+
+  // the program terminates, write the pending events of all threads
+  int i;
+  for(i = 0; i < MAX_THREADS; i++) {
+    if(__atomic_load_n(&heap_buffers[i].used, __ATOMIC_ACQUIRE))
+      flush_heap_buffer(&heap_buffers[i]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void* get_context_pc(void* context) {
+  ucontext_t* uc = (ucontext_t*) context;
+#if defined(__x86_64__)
+  return (void*) uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+  return (void*) uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+  return (void*) uc->uc_mcontext.pc;
+#else
+  (void) uc;
+  return NULL;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void get_context_frame(void* context, uintptr_t* sp, uintptr_t* fp) {
+  ucontext_t* uc = (ucontext_t*) context;
+#if defined(__x86_64__)
+  *sp = uc->uc_mcontext.gregs[REG_RSP];
+  *fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+  *sp = uc->uc_mcontext.gregs[REG_ESP];
+  *fp = uc->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+  *sp = uc->uc_mcontext.sp;
+  *fp = uc->uc_mcontext.regs[29];
+#else
+  (void) uc;
+  *sp = *fp = 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+int follows_call(uintptr_t addr) {
+#if defined(__x86_64__) || defined(__i386__)
+  // call rel32, or an indirect call (ff /2) of 2, 3, 6 or 7 bytes
+  static const int lengths[] = { 2, 3, 6, 7 };
+  size_t i;
+  if(is_target_address((void*) (addr - 5)) && *(const uint8_t*) (addr - 5) == 0xe8)
+    return 1;
+  for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    const uint8_t* call = (const uint8_t*) (addr - lengths[i]);
+    if(is_target_address(call) && call[0] == 0xff && (call[1] & 0x38) == 0x10)
+      return 1;
+  }
+  return 0;
+#else
+  (void) addr;
+  return 1;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+size_t read_stack(uintptr_t addr, uintptr_t* words, size_t count) {
+  // the stack may be broken, the kernel reads it without faulting, page by
+  // page so the words up to an unmapped page are still read
+  struct iovec local = { words, count * sizeof(uintptr_t) };
+  struct iovec remote[CRASH_SCAN_PAGES];
+  size_t pages = 0, done = 0, size = count * sizeof(uintptr_t);
+  while(done < size && pages < CRASH_SCAN_PAGES) {
+    uintptr_t pos = addr + done, end = (pos | (CRASH_PAGE_SIZE - 1)) + 1;
+    remote[pages].iov_base = (void*) pos;
+    remote[pages].iov_len = end - pos < size - done ? end - pos : size - done;
+    done += remote[pages++].iov_len;
+  }
+  local.iov_len = done;
+  ssize_t n = process_vm_readv(getpid(), &local, 1, remote, pages, 0);
+  return n > 0 ? n / sizeof(uintptr_t) : 0;
+}
+
+//-----------------------------------------------------------------------------
+int is_frame_pointer(uintptr_t fp, uintptr_t sp) {
+  // within the thread stack above the crash, never on the stack of the handler
+  return fp > sp && fp - sp < stack_limit && !(fp % sizeof(uintptr_t))
+      && !(signal_stack && fp >= (uintptr_t) signal_stack && fp < (uintptr_t) signal_stack + SIGNAL_STACK_SIZE);
+}
+
+//-----------------------------------------------------------------------------
+uintptr_t find_return_address(uintptr_t sp, uintptr_t* slot) {
+  // the first target address above the stack pointer which follows a call
+  uintptr_t words[CRASH_SCAN_WORDS];
+  size_t i, count = read_stack(sp, words, CRASH_SCAN_WORDS);
+  for(i = 0; i < count; i++) {
+    if(is_target_address((void*) words[i]) && follows_call(words[i])) {
+      *slot = sp + i * sizeof(uintptr_t);
+      return words[i];
+    }
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+uintptr_t find_frame_pointer(uintptr_t slot) {
+  // the first frame record above the slot: a frame pointer further up, next
+  // to a return address into the target
+  uintptr_t words[CRASH_SCAN_WORDS];
+  size_t i, count = read_stack(slot, words, CRASH_SCAN_WORDS);
+  for(i = 1; i + 1 < count; i++) {
+    uintptr_t pos = slot + i * sizeof(uintptr_t);
+    if(is_frame_pointer(words[i], pos) && is_target_address((void*) words[i + 1]) && follows_call(words[i + 1]))
+      return pos;
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+int get_crash_stack(void* context, void** frames, int depth) {
+  // the unwinder takes the loader lock, the handler follows frame pointers:
+  // the saved frame pointer first, the return address next to it
+  uintptr_t pc = (uintptr_t) get_context_pc(context), sp, fp, slot;
+  get_context_frame(context, &sp, &fp);
+  int count = 0, walked;
+  if(pc && is_target_address((void*) pc)) {
+    frames[count++] = (void*) (pc - target_base);
+    slot = sp;
+  } else {
+    // crashed in a library, maybe without frame pointers, its caller in the
+    // target left the return address on the stack
+    uintptr_t caller = find_return_address(sp, &slot);
+    if(caller)
+      frames[count++] = (void*) (caller - target_base);
+    else
+      slot = sp;
+  }
 
-  cmap_iterator* it = map(heap)->iterator();
-  FILE* f = fopen("heap", "wb");
-  while(!map_iterator(it)->end()) {
-    HeapEntry h;
-    void* addr = map_iterator(it)->key();
-    h.address = (uint64_t) map(heap_location)->get(addr);
-    h.size = (uint64_t) map_iterator(it)->value();
-    fwrite(&h, sizeof(HeapEntry), 1, f);
-    map_iterator(it)->next();
+  // frames of the library below the return address are skipped, if their
+  // chain breaks before, the walk starts again from the frame of the caller
+  int retried = 0;
+  for(walked = 0; walked < CRASH_WALK_LIMIT && count < depth; walked++) {
+    uintptr_t frame[2];
+    if(!is_frame_pointer(fp, sp) || read_stack(fp, frame, 2) != 2 || (frame[0] <= fp && fp < slot)) {
+      if(retried || !(fp = find_frame_pointer(slot)))
+        break;
+      retried = 1;
+      continue;
+    }
+    if(fp >= slot && is_target_address((void*) frame[1]))
+      frames[count++] = (void*) (frame[1] - target_base);
+    // the stack grows down, callers are always further up
+    if(frame[0] <= fp)
+      break;
+    fp = frame[0];
   }
-  map_iterator(it)->destroy();
-  fclose(f);
+  return count;
 }
 
 //-----------------------------------------------------------------------------
-void segfault_handler(int sig) {
+void flush_stream(FILE* stream) {
+  // never wait for a lock, the crash might have happened while holding it
+  if(ftrylockfile(stream))
+    return;
+  fflush_unlocked(stream);
+  funlockfile(stream);
+}
+
+//-----------------------------------------------------------------------------
+void segfault_handler(int sig, siginfo_t* info, void* context) {
   block();
+  internal++;
+
+  // write crash report, only plain stores into the mapped record
+  if(record) {
+    void* frames[CRASH_STACK_DEPTH];
+    int i, depth = get_crash_stack(context, frames, CRASH_STACK_DEPTH);
+    for(i = 0; i < depth; i++) {
+      record->stack[i] = (uint64_t) (uintptr_t) frames[i];
+    }
+    record->stack_depth = depth;
 
-  // write crash report
-  FILE* f = fopen("crash", "wb");
-  CrashEntry e;
-  e.crash = (uint64_t) get_return_address(0);
-  e.fault = (uint64_t) current_fault;
+    // the faulting instruction, or the innermost target frame if it is outside
+    uintptr_t pc = (uintptr_t) get_context_pc(context);
+    if(pc && is_target_address((void*) pc)) {
+      pc -= target_base;
+      record->crash.crash = pc;
+    } else {
+      record->crash.crash = depth ? record->stack[0] : 0;
+    }
+    record->pc = pc;
+    record->signal = sig;
+    record->data_address = info->si_code > 0 ? (uint64_t) (uintptr_t) info->si_addr : 0;
+    record->crash.fault = (uint64_t) (uintptr_t) current_fault;
+    __atomic_store_n(&record->crashed, 1, __ATOMIC_RELEASE);
+  }
+
+  // saving takes locks, skip it if the library itself crashed
+  if(internal == 1) {
+    save_profile();
+    save_heap();
+    save_calls();
+  }
+  wait_for_explorations(0);
+  flush_stream(stdout);
+  flush_stream(stderr);
+  real_exit_(sig + 128);
+}
+
+//-----------------------------------------------------------------------------
+static inline uint8_t* put_varint(uint8_t* pos, uint64_t value) {
+  while(value >= 0x80) {
+    *pos++ = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  *pos++ = (uint8_t) value;
+  return pos;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t get_timestamp() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
 
-  fwrite(&e, sizeof(CrashEntry), 1, f);
-  fclose(f);
+//-----------------------------------------------------------------------------
+CallBuffer* get_call_buffer() {
+  if(call_buffer)
+    return call_buffer;
+
+  // claim a free buffer for this thread, it is released when the thread exits
+  int i;
+  for(i = 0; i < MAX_THREADS; i++) {
+    int expected = 0;
+    if(__atomic_compare_exchange_n(&call_buffers[i].used, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      call_buffer = &call_buffers[i];
+      call_buffer->thread = (uint32_t) syscall(SYS_gettid);
+      call_buffer->length = sizeof(CallBlock);
+      pthread_setspecific(call_buffer_key, call_buffer);
+      return call_buffer;
+    }
+  }
+  return NULL;
+}
 
-  unblock();
-  exit(sig + 128);
+//-----------------------------------------------------------------------------
+void release_call_buffer(void* buffer) {
+  Internal in;
+  CallBuffer* b = (CallBuffer*) buffer;
+  flush_call_buffer(b);
+  call_buffer = NULL;
+  __atomic_store_n(&b->used, 0, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+void reset_call_buffers() {
+  // a forked child only has the calling thread, pending events are the parent's
+  int i;
+  for(i = 0; i < MAX_THREADS; i++) {
+    if(&call_buffers[i] != call_buffer)
+      call_buffers[i].used = 0;
+    call_buffers[i].length = sizeof(CallBlock);
+  }
+  if(call_buffer)
+    call_buffer->thread = (uint32_t) syscall(SYS_gettid);
 }
 
+//-----------------------------------------------------------------------------
+void flush_call_buffer(CallBuffer* buffer) {
+  CallBlock* block = (CallBlock*) buffer->data;
+  if(buffer->length <= sizeof(CallBlock))
+    return;
+  // header and events in a single write, blocks of threads never interleave
+  block->type = CALL_BLOCK_EVENTS;
+  block->thread = buffer->thread;
+  block->size = buffer->length - sizeof(CallBlock);
+  write_all(calls_fd, buffer->data, buffer->length);
+  buffer->length = sizeof(CallBlock);
+}
+
+//-----------------------------------------------------------------------------
+void log_call(size_t id, size_t size) {
+  uint64_t now = get_timestamp();
+  CallBuffer* buffer = get_call_buffer();
+  if(!buffer) {
+    // more threads than buffers, write a block with a single event
+    uint8_t data[sizeof(CallBlock) + CALL_EVENT_MAX];
+    CallBlock* block = (CallBlock*) data;
+    uint8_t* end = put_varint(put_varint(put_varint(data + sizeof(CallBlock), id), 0), size);
+    block->type = CALL_BLOCK_EVENTS;
+    block->thread = (uint32_t) syscall(SYS_gettid);
+    block->start = now;
+    block->count = 1;
+    block->size = end - data - sizeof(CallBlock);
+    write_all(calls_fd, data, end - data);
+    return;
+  }
+
+  // times are relative to the previous event of the block
+  CallBlock* block = (CallBlock*) buffer->data;
+  if(buffer->length == sizeof(CallBlock)) {
+    block->start = now;
+    block->count = 0;
+    buffer->last = now;
+  }
+  uint8_t* end = put_varint(buffer->data + buffer->length, id);
+  end = put_varint(end, now - buffer->last);
+  end = put_varint(end, size);
+  buffer->length = end - buffer->data;
+  buffer->last = now;
+  block->count++;
+  if(buffer->length > CALL_BUFFER_SIZE - CALL_EVENT_MAX)
+    flush_call_buffer(buffer);
+}
+
+//-----------------------------------------------------------------------------
+void save_calls() {
+  if(calls_fd == -1)
+    return;
+
+  // the program terminates, write the pending events of all threads
+  int i;
+  for(i = 0; i < MAX_THREADS; i++) {
+    if(__atomic_load_n(&call_buffers[i].used, __ATOMIC_ACQUIRE))
+      flush_call_buffer(&call_buffers[i]);
+  }
+
+  // the site table, again only if sites were added since the last one
+  size_t count = __atomic_load_n(&site_count, __ATOMIC_RELAXED);
+  if(count == saved_sites)
+    return;
+  Internal in;
+  size_t m, names = 0;
+  for(m = 0; m < get_module_count(); m++) {
+    names = strlen(get_module(m)) > names ? strlen(get_module(m)) : names;
+  }
+  size_t capacity = sizeof(CallBlock) + count * (4 * 10 + names);
+  uint8_t* data = (uint8_t*) map_buffer(capacity);
+  if(!data)
+    return;
+  uint8_t* end = data + sizeof(CallBlock);
+  size_t written = 0;
+  for(i = 0; i < MAX_SITES && written < count; i++) {
+    unsigned int id = __atomic_load_n(&sites[i].id, __ATOMIC_ACQUIRE);
+    if(!id)
+      continue;
+    end = put_varint(end, id - 1);
+    end = put_varint(end, (uint64_t) (uintptr_t) sites[i].key);
+    end = put_varint(end, (uint64_t) (uintptr_t) sites[i].stack[0]);
+    // the module by name, the trace is read without the profile
+    const char* name = get_module(sites[i].type);
+    end = put_varint(end, strlen(name));
+    memcpy(end, name, strlen(name));
+    end += strlen(name);
+    written++;
+  }
+  CallBlock* block = (CallBlock*) data;
+  block->type = CALL_BLOCK_SITES;
+  block->thread = 0;
+  block->start = get_timestamp();
+  block->count = written;
+  block->size = end - data - sizeof(CallBlock);
+  write_all(calls_fd, data, end - data);
+  munmap(data, capacity);
+  saved_sites = count;
+}
@@ -24,6 +24,7 @@
 #define _FAULT_INJECT_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <execinfo.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -31,14 +32,80 @@
 #include <typeinfo>
 #include <cxxabi.h>
 
+#include "settings.h"
+
 #ifndef __USE_GNU
 #define __USE_GNU
 #endif
 #include <dlfcn.h>
+#include <link.h>
+#include <unwind.h>
 
 #define FAIL 0
 #define WRAP 1
 #define REAL 2
+#define TRACE 3 // like WRAP, but the heap event is recorded as well
+
+#define MAX_TEXT_RANGES 16
+#define HEAP_BUFFER_EVENTS 1024
+#define MAX_THREADS 128
+#define COUNTER_SHARDS 16
+#define MAX_EXPLORATIONS 256
+// interval in which finished explorations are collected
+#define EXPLORATION_POLL 1000000 // ns
+#define SIGNAL_STACK_SIZE (64 * 1024)
+// frames the crash handler follows at most, target frames or not
+#define CRASH_WALK_LIMIT 256
+// words above the stack pointer searched for the caller of a crashed library
+#define CRASH_SCAN_WORDS 512
+#define CRASH_PAGE_SIZE 4096
+#define CRASH_SCAN_PAGES 8
+#define CALL_BUFFER_SIZE (16 * 1024)
+#define CALL_EVENT_MAX 30 // three varints
+
+// address range of an executable segment
+typedef struct {
+  uintptr_t start;
+  uintptr_t end;
+} TextRange;
+
+// profiled call site, the key is set once when the slot is claimed
+typedef struct {
+  void* key;
+  size_t type;
+  int depth;
+  void* stack[MAX_STACK_DEPTH];
+  int flags;
+  unsigned int id;
+} SiteEntry;
+
+// state of a stack walk collecting frames inside the target
+typedef struct {
+  void** frames;
+  int depth;
+  int count;
+} StackWalk;
+
+// encoded call events of one thread, the block header is kept in front
+typedef struct {
+  int used;
+  uint32_t thread;
+  uint64_t last;
+  size_t length;
+  uint8_t data[CALL_BUFFER_SIZE];
+} CallBuffer;
+
+// heap events of one thread
+typedef struct {
+  int used;
+  int count;
+  HeapEvent events[HEAP_BUFFER_EVENTS];
+} HeapBuffer;
+
+//-----------------------------------------------------------------------------
+static inline size_t site_hash(const void* address) {
+  return (size_t) (((uint64_t) (size_t) address * 0x9E3779B97F4A7C15ULL) >> 32);
+}
 
 // function signatures of fault injectable functions
 typedef void* (*h_malloc)(size_t);
@@ -51,8 +118,64 @@ typedef size_t (*h_fread)(void*, size_t, size_t, FILE*);
 typedef size_t (*h_fwrite)(const void*, size_t, size_t, FILE*);
 typedef void (*h_free)(void*);
 typedef void (*h_exit)(int);
+typedef int (*h_main)(int, char**, char**);
+typedef int (*h_libc_start_main)(h_main, int, char**, void (*)(void), void (*)(void), void (*)(void), void*);
+
+// decides what to do with an intercepted call: FAIL, WRAP, REAL or TRACE
+typedef int (*h_handler)(size_t module, void** site, size_t size);
 
-void segfault_handler(int sig);
+void* get_context_pc(void* context);
+void get_context_frame(void* context, uintptr_t* sp, uintptr_t* fp);
+int follows_call(uintptr_t addr);
+size_t read_stack(uintptr_t addr, uintptr_t* words, size_t count);
+int is_frame_pointer(uintptr_t fp, uintptr_t sp);
+uintptr_t find_return_address(uintptr_t sp, uintptr_t* slot);
+uintptr_t find_frame_pointer(uintptr_t slot);
+int get_crash_stack(void* context, void** frames, int depth);
+void flush_stream(FILE* stream);
+void segfault_handler(int sig, siginfo_t* info, void* context);
 void save_heap();
+uint64_t next_heap_sequence();
+void log_heap_event(uint8_t type, void* block, void* site, size_t size, uint64_t sequence = 0);
+HeapBuffer* get_heap_buffer();
+void release_heap_buffer(void* buffer);
+void write_heap_events(const HeapEvent* events, int count);
+void flush_heap_buffer(HeapBuffer* buffer);
+void* map_buffer(size_t size);
+void write_all(int fd, const void* data, size_t len);
+uint64_t get_timestamp();
+CallBuffer* get_call_buffer();
+void release_call_buffer(void* buffer);
+void reset_call_buffers();
+void flush_call_buffer(CallBuffer* buffer);
+void log_call(size_t id, size_t size);
+void save_calls();
+SiteEntry* get_site(void* key, size_t type, void** frames, int depth);
+size_t get_site_id(SiteEntry* site);
+void save_profile();
+void sort_profile_entries(ProfileEntry* entries, size_t count);
+int map_control();
+void read_build_id(const char* note, size_t size);
+int collect_text_ranges(struct dl_phdr_info* info, size_t size, void* data);
+int is_target_address(const void* addr);
+_Unwind_Reason_Code collect_target_frame(struct _Unwind_Context* context, void* data);
+int get_target_stack(void* caller, void** frames, int depth);
+void* get_return_address(void* caller);
+void* get_site_key(void** frames, int depth);
+int is_valgrind();
+int handle_passthrough(size_t module, void** site, size_t size);
+int handle_uninitialized(size_t module, void** site, size_t size);
+void select_handler();
+int start_main(int argc, char** argv, char** envp);
+int receive_fork_request(int control, ForkRequest* request, int* output);
+void run_fork_server(const char* channel);
+void arm_run(int run);
+ssize_t find_run(void* key);
+int get_thread_count();
+int explore_site(void* key);
+void wait_for_explorations(int limit);
+void reap_explorations();
+void save_exploration_output(int run, int fd);
+void save_exploration(int run, int status, int timed_out);
 
 #endif
@@ -22,12 +22,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "map.h"
 
-void* _obj_addr[MAX_MAP_NESTING];
-int _obj_addr_pos = 0;
+// every thread has its own nesting stack
+__thread void* _obj_addr[MAX_MAP_NESTING];
+__thread int _obj_addr_pos = 0;
 
 allocator map_allocate = malloc;
+deallocator map_deallocate = free;
 
 #define this ((cmap*)_obj_addr[_obj_addr_pos - 1])
 #define thisit ((cmap_iterator*)_obj_addr[_obj_addr_pos - 1])
@@ -84,7 +87,9 @@ cmap* map(cmap* m) {
 
 // ---------------------------------------------------------------------------
 int map_hash(const void* key, int size) {
-  return (long) key % size;
+  // keys are mostly aligned pointers, mix the bits before reducing
+  unsigned long long h = (unsigned long long) (size_t) key * 0x9E3779B97F4A7C15ULL;
+  return (int) ((h >> 32) % (unsigned int) size);
 }
 
 // ---------------------------------------------------------------------------
@@ -106,7 +111,8 @@ cmap_entry* _map_key_position(cmap* m, const void* key) {
 
 // ---------------------------------------------------------------------------
 void _map_resize(cmap* m, int new_size) {
-  cmap_entry* new_data = (cmap_entry*) calloc(sizeof(cmap_entry), new_size);
+  cmap_entry* new_data = (cmap_entry*) map_allocate(sizeof(cmap_entry) * new_size);
+  memset(new_data, 0, sizeof(cmap_entry) * new_size);
   // iterate over all entries and insert into new structure
   int i;
   for(i = 0; i < m->size; i++) {
@@ -117,10 +123,10 @@ void _map_resize(cmap* m, int new_size) {
       cmap_entry_append(&new_data[position], start->key, start->value);
       cmap_entry* last = start;
       start = start->next;
-      free(last);
+      map_deallocate(last);
     }
   }
-  free(m->data);
+  map_deallocate(m->data);
   m->data = new_data;
   m->size = new_size;
 }
@@ -166,7 +172,7 @@ void map_unset(const void* key) {
     if(this->compare(start->key, key)) {
       cmap_entry* tofree = last->next;
       last->next = start->next;
-      free(tofree);
+      map_deallocate(tofree);
       (this->data[position]).value = (void*) (((size_t) ((this->data[position]).value)) - 1);
       this->entries--;
       objreturn
@@ -185,7 +191,7 @@ void map_clear() {
     while(start) {
       cmap_entry* last = start;
       start = start->next;
-      free(last);
+      map_deallocate(last);
     }
     (this->data[i]).value = 0;
     (this->data[i]).next = NULL;
@@ -197,10 +203,10 @@ void map_clear() {
 // ---------------------------------------------------------------------------
 void map_destroy() {
   map(this)->clear();
-  free(this->data);
+  map_deallocate(this->data);
   this->data = 0;
   this->size = 0;
-  free(this);
+  map_deallocate(this);
   objreturn
 ;}
 
@@ -251,7 +257,7 @@ int map_iterator_end() {
 
 // ---------------------------------------------------------------------------
 void map_iterator_destroy() {
-  free(thisit);
+  map_deallocate(thisit);
   objreturn
 ;}
 
@@ -294,12 +300,13 @@ void map_dump() {
 void map_init(int size) {
   if(this->data) {
     map(this)->clear();
-    free(this->data);
+    map_deallocate(this->data);
   }
 
   this->size = size;
   this->entries = 0;
-  this->data = (cmap_entry*) calloc(sizeof(cmap_entry), this->size);
+  this->data = (cmap_entry*) map_allocate(sizeof(cmap_entry) * this->size);
+  memset(this->data, 0, sizeof(cmap_entry) * this->size);
   objreturn
 ;}
 
@@ -327,7 +334,7 @@ void _map_init(cmap** m) {
 // ---------------------------------------------------------------------------
 int map_hash_str(const void *str_, int size) {
   unsigned char* str = (unsigned char*) str_;
-  int hash = 5381;
+  unsigned int hash = 5381;
   int c;
 
   while((c = *str++))
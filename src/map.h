@@ -26,11 +26,13 @@
 #define MAX_MAP_NESTING 32
 #define MAP_START_SIZE 8
 
-extern void* _obj_addr[MAX_MAP_NESTING];
-extern int _obj_addr_pos;
+extern __thread void* _obj_addr[MAX_MAP_NESTING];
+extern __thread int _obj_addr_pos;
 
 typedef void* (*allocator)(size_t);
+typedef void (*deallocator)(void*);
 extern allocator map_allocate;
+extern deallocator map_deallocate;
 
 enum map_type {
   MAP_GENERAL, MAP_STRING
@@ -24,21 +24,11 @@
 #include "modules.h"
 
 // ---------------------------------------------------------------------------
+#define MODULE_NAME(id, name) name,
 const char* modules[] = {
-  "(unknown)",
-  "malloc",
-  "realloc",
-  "calloc",
-  "new",
-  "fopen",
-  "getline",
-  "fgets",
-  "fread",
-  "fwrite"
+  MODULE_LIST(MODULE_NAME)
 };
-
-// ---------------------------------------------------------------------------
-const size_t MODULE_COUNT = (sizeof(modules) / sizeof(modules[0]));
+#undef MODULE_NAME
 
 // ---------------------------------------------------------------------------
 size_t get_module_count() {
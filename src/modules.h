@@ -25,6 +25,26 @@
 
 #include <stdlib.h>
 
+// all fault injectable functions, the position in the list is the module id
+#define MODULE_LIST(X) \
+  X(UNKNOWN, "(unknown)") \
+  X(MALLOC, "malloc") \
+  X(REALLOC, "realloc") \
+  X(CALLOC, "calloc") \
+  X(NEW, "new") \
+  X(FOPEN, "fopen") \
+  X(GETLINE, "getline") \
+  X(FGETS, "fgets") \
+  X(FREAD, "fread") \
+  X(FWRITE, "fwrite")
+
+#define MODULE_ID(id, name) MODULE_##id,
+enum ModuleId {
+  MODULE_LIST(MODULE_ID)
+  MODULE_COUNT
+};
+#undef MODULE_ID
+
 size_t get_module_count();
 const char* get_module(int i);
 size_t get_module_id(const char* module);
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "modules.h"
+#include "elf_file.h"
+#include "profile.h"
+
+// ---------------------------------------------------------------------------
+static int in_file(const ProfileFile* profile, uint64_t offset, uint64_t size) {
+  return offset <= profile->size && size <= profile->size - offset;
+}
+
+// ---------------------------------------------------------------------------
+static int validate(ProfileFile* profile) {
+  const ProfileHeader* h = profile->header;
+  if(h->magic != PROFILE_MAGIC)
+    return PROFILE_INVALID;
+  if(h->version != PROFILE_VERSION || h->entry_size != sizeof(ProfileEntry))
+    return PROFILE_UNSUPPORTED;
+
+  // every table has to be inside of the file, the sites aligned
+  if(h->site_count > profile->size / sizeof(ProfileEntry) || h->module_count > profile->size / sizeof(uint32_t)
+      || !in_file(profile, h->module_offset, h->module_count * sizeof(uint32_t))
+      || !in_file(profile, h->site_offset, h->site_count * sizeof(ProfileEntry))
+      || !in_file(profile, h->string_offset, h->string_size) || (h->site_offset & 7)
+      || (h->string_size && profile->data[h->string_offset + h->string_size - 1]))
+    return PROFILE_INVALID;
+  profile->sites = (const ProfileEntry*) (profile->data + h->site_offset);
+  profile->count = h->site_count;
+
+  // module ids are stored, they have to mean the same as ours
+  const uint32_t* modules = (const uint32_t*) (profile->data + h->module_offset);
+  size_t i;
+  for(i = 0; i < h->module_count; i++) {
+    if(modules[i] >= h->string_size)
+      return PROFILE_INVALID;
+    if(i >= get_module_count() || strcmp(get_module(i), profile_get_module(profile, i)))
+      return PROFILE_MODULES;
+  }
+  for(i = 0; i < profile->count; i++) {
+    if(profile->sites[i].type >= h->module_count || profile->sites[i].depth > MAX_STACK_DEPTH
+        || (i && profile->sites[i - 1].key >= profile->sites[i].key))
+      return PROFILE_INVALID;
+  }
+  return PROFILE_OK;
+}
+
+// ---------------------------------------------------------------------------
+int profile_open(int fd, ProfileFile* profile) {
+  memset(profile, 0, sizeof(ProfileFile));
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) || st.st_size == 0)
+    return PROFILE_EMPTY;
+  if(st.st_size < (off_t) sizeof(ProfileHeader))
+    return PROFILE_INVALID;
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(data == MAP_FAILED)
+    return PROFILE_EMPTY;
+  profile->data = data;
+  profile->size = st.st_size;
+  profile->header = (const ProfileHeader*) data;
+
+  int error = validate(profile);
+  if(error != PROFILE_OK)
+    profile_close(profile);
+  return error;
+}
+
+// ---------------------------------------------------------------------------
+void profile_close(ProfileFile* profile) {
+  if(profile->data)
+    munmap((void*) profile->data, profile->size);
+  memset(profile, 0, sizeof(ProfileFile));
+}
+
+// ---------------------------------------------------------------------------
+const char* profile_error(int error) {
+  switch(error) {
+    case PROFILE_OK:
+      return "ok";
+    case PROFILE_EMPTY:
+      return "no profile was written";
+    case PROFILE_UNSUPPORTED:
+      return "profile was written by a different version";
+    case PROFILE_MODULES:
+      return "profile uses different modules";
+    case PROFILE_TARGET:
+      return "profile belongs to a different binary";
+    default:
+      return "not a valid profile";
+  }
+}
+
+// ---------------------------------------------------------------------------
+int profile_check_target(const ProfileFile* profile, const char* binary) {
+  // without a build id, there is nothing to compare
+  char id[BUILD_ID_LENGTH] = { 0 };
+  get_build_id(binary, id);
+  if(strncmp(id, profile->header->build_id, PROFILE_BUILD_ID_LENGTH))
+    return PROFILE_TARGET;
+  return PROFILE_OK;
+}
+
+// ---------------------------------------------------------------------------
+const char* profile_get_module(const ProfileFile* profile, size_t type) {
+  const uint32_t* modules = (const uint32_t*) (profile->data + profile->header->module_offset);
+  if(type >= profile->header->module_count)
+    return get_module(0);
+  return (const char*) profile->data + profile->header->string_offset + modules[type];
+}
+
+// ---------------------------------------------------------------------------
+const ProfileEntry* profile_find_site(const ProfileFile* profile, uint64_t key) {
+  // the sites are sorted by key
+  size_t low = 0, high = profile->count;
+  while(low < high) {
+    size_t mid = low + (high - low) / 2;
+    if(profile->sites[mid].key < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if(low < profile->count && profile->sites[low].key == key)
+    return &profile->sites[low];
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+int profile_write(const ProfileFile* profile, int fd) {
+  size_t done = 0;
+  while(done < profile->size) {
+    ssize_t n = write(fd, profile->data + done, profile->size - done);
+    if(n <= 0)
+      return 0;
+    done += n;
+  }
+  return 1;
+}
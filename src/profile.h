@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_PROFILE_H_
+#define SRC_PROFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "settings.h"
+
+enum ProfileError {
+  PROFILE_OK, PROFILE_EMPTY, PROFILE_INVALID, PROFILE_UNSUPPORTED, PROFILE_MODULES, PROFILE_TARGET
+};
+
+// a profile file mapped read-only, the sites are used where they are
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  const ProfileHeader* header;
+  const ProfileEntry* sites;
+  size_t count;
+} ProfileFile;
+
+int profile_open(int fd, ProfileFile* profile);
+void profile_close(ProfileFile* profile);
+const char* profile_error(int error);
+int profile_check_target(const ProfileFile* profile, const char* binary);
+const char* profile_get_module(const ProfileFile* profile, size_t type);
+const ProfileEntry* profile_find_site(const ProfileFile* profile, uint64_t key);
+int profile_write(const ProfileFile* profile, int fd);
+
+#endif /* SRC_PROFILE_H_ */
@@ -25,9 +25,32 @@
 
 #include <stdint.h>
 
+#define MAX_STACK_DEPTH 8
+// size of the site table of the library, bounds the ids of a call trace
+#define MAX_SITES 65536
+
+// number of the injection run, "server" for fork servers and "explore" for
+// the exploration
+#define RUN_ENV "FAINT_RUN"
+
+// file descriptors inherited from the driver: the shared control block, the
+// profile written by the profiling run, the heap log of the run and the
+// output log of the exploration
+#define CONTROL_ENV "FAINT_CONTROL"
+#define PROFILE_ENV "FAINT_PROFILE"
+#define HEAP_ENV "FAINT_HEAP"
+#define CALLS_ENV "FAINT_CALLS"
+#define OUTPUT_ENV "FAINT_OUTPUT"
+
+// file descriptors of the fork server pipes, "<control>,<status>"
+#define FORK_SERVER_ENV "FAINT_FORKSERVER"
+
+// site flags in the profile
+#define SITE_BEFORE_MAIN 1
+
 // ---------------------------------------------------------------------------
 enum Mode {
-  PROFILE, INJECT
+  PROFILE, INJECT, EXPLORE
 };
 
 // ---------------------------------------------------------------------------
@@ -37,15 +60,57 @@ typedef struct {
     uint32_t modules;
     enum Mode mode;
     uint8_t trace_heap;
+    int32_t stack_depth;
+    int32_t jobs;
+    // seconds an injection run may take, 0 for no limit
+    double timeout;
 }__attribute__((packed)) FaultSettings;
 
 // ---------------------------------------------------------------------------
+// one site of the profile, the sites are sorted by key. addresses are offsets
+// into the binary under test (its link time addresses), they do not depend on
+// where it was loaded
 typedef struct {
     uint64_t address;
     uint64_t count;
     uint64_t type;
+    uint64_t key;
+    uint32_t depth;
+    uint64_t stack[MAX_STACK_DEPTH];
+    uint32_t flags;
 }__attribute__((packed)) ProfileEntry;
 
+// ---------------------------------------------------------------------------
+// the profile file starts with this header, followed by the module table (one
+// string offset per module id), the sites and the string table. all offsets
+// are relative to the start of the file, so it can be mapped as it is
+#define PROFILE_MAGIC 0x464f5250
+#define PROFILE_VERSION 1
+#define PROFILE_BUILD_ID_LENGTH 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t module_count;
+    uint64_t site_count;
+    uint64_t module_offset;
+    uint64_t site_offset;
+    uint64_t string_offset;
+    uint64_t string_size;
+    // of the binary under test, empty if it has none
+    char build_id[PROFILE_BUILD_ID_LENGTH];
+}__attribute__((packed)) ProfileHeader;
+
+// ---------------------------------------------------------------------------
+// sent to a fork server, which answers with the pid of the forked run and,
+// once it terminated, its wait status
+typedef struct {
+    int32_t run;
+    // the output file of the run is attached to the message
+    int32_t capture_output;
+}__attribute__((packed)) ForkRequest;
+
 // ---------------------------------------------------------------------------
 typedef struct {
     uint64_t fault;
@@ -53,9 +118,116 @@ typedef struct {
 }__attribute__((packed)) CrashEntry;
 
 // ---------------------------------------------------------------------------
+// number of target frames kept of a crashing stack
+#define CRASH_STACK_DEPTH 16
+
+// ---------------------------------------------------------------------------
+// state of a site during exploration, skipped sites were reached while the
+// target had several threads and are left to a normal injection run
+enum Exploration {
+  EXPLORE_NONE, EXPLORE_FORKED, EXPLORE_DONE, EXPLORE_SKIPPED
+};
+
+// ---------------------------------------------------------------------------
+// one record per run in the control block, only written by the run itself
+// (or by the exploration which forked it), read by the driver once the run
+// terminated
+typedef struct {
+    uint64_t armed;
+    CrashEntry crash;
+    uint32_t injected;
+    uint32_t crashed;
+    uint32_t explored;
+    int32_t status;
+    // set by the exploration if it killed the run after its deadline, the
+    // padding keeps the layout of 32 and 64 bit targets the same
+    uint32_t timed_out;
+    uint32_t reserved;
+    // written by the crash handler, pc is relative to the binary if the
+    // faulting instruction is inside of it, the stack holds target frames
+    int32_t signal;
+    uint32_t stack_depth;
+    uint64_t pc;
+    uint64_t data_address;
+    uint64_t stack[CRASH_STACK_DEPTH];
+} RunRecord;
+
+// ---------------------------------------------------------------------------
+// shared memory between the driver and all runs, the records start at a
+// fixed offset so 32 and 64 bit targets agree on the layout
+#define CONTROL_MAGIC 0x544e4941
+#define CONTROL_VERSION 3
+#define CONTROL_HEADER_SIZE 512
+#define CONTROL_SIZE(runs) (CONTROL_HEADER_SIZE + ((size_t) (runs) + 1) * sizeof(RunRecord))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t runs;
+    FaultSettings settings;
+}__attribute__((packed)) ControlBlock;
+
+// the header must not run into the first record
+#ifdef __cplusplus
+static_assert(sizeof(ControlBlock) <= CONTROL_HEADER_SIZE, "ControlBlock does not fit into CONTROL_HEADER_SIZE");
+#else
+_Static_assert(sizeof(ControlBlock) <= CONTROL_HEADER_SIZE, "ControlBlock does not fit into CONTROL_HEADER_SIZE");
+#endif
+
+// slot 0 belongs to processes which are no injection run
+#define RUN_SLOT(run) ((run) + 1)
+#define CONTROL_RECORD(block, slot) ((RunRecord*) ((char*) (block) + CONTROL_HEADER_SIZE) + (slot))
+
+// ---------------------------------------------------------------------------
+// the exploration appends the output of every run it forked to its output
+// log, each one with this header
 typedef struct {
+    int32_t run;
+    uint32_t reserved;
+    uint64_t size;
+}__attribute__((packed)) OutputRecord;
+
+// ---------------------------------------------------------------------------
+enum HeapEventType {
+  HEAP_ALLOC = 1, HEAP_FREE = 2
+};
+
+// ---------------------------------------------------------------------------
+// threads flush their events in any order, the sequence number restores the
+// order in which they happened
+typedef struct {
+    uint64_t sequence;
+    uint64_t block;
     uint64_t address;
     uint64_t size;
-}__attribute__((packed)) HeapEntry;
+    uint8_t type;
+}__attribute__((packed)) HeapEvent;
+
+// ---------------------------------------------------------------------------
+// ordered trace of all intercepted calls of the profiling run. the header is
+// followed by blocks, each written at once by one thread. the events of a
+// block are varints: site id, nanoseconds since the previous event of the
+// block (the first one is at start) and size. sites are numbered in the order
+// of their first hit, site blocks map the ids to sites with one entry per
+// site: varints id, key and address, then length and name of the module
+#define CALLS_MAGIC 0x534c4c43
+#define CALLS_VERSION 1
+
+enum CallBlockType {
+  CALL_BLOCK_EVENTS = 1, CALL_BLOCK_SITES = 2
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+}__attribute__((packed)) CallTraceHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t thread;
+    uint64_t start;
+    uint32_t count;
+    uint32_t size;
+}__attribute__((packed)) CallBlock;
 
 #endif
@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "supervisor.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// ---------------------------------------------------------------------------
+double get_time() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// ---------------------------------------------------------------------------
+int supervisor_init(Supervisor* s, int size) {
+  s->size = size > 0 ? size : 1;
+  s->signal_fd = -1;
+  s->runs = calloc(s->size, sizeof(SupervisedRun));
+  s->epoll = epoll_create1(EPOLL_CLOEXEC);
+  if(!s->runs || s->epoll == -1) {
+    free(s->runs);
+    if(s->epoll != -1)
+      close(s->epoll);
+    return 0;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void supervisor_destroy(Supervisor* s) {
+  int i;
+  for(i = 0; i < s->size; i++) {
+    if(s->runs[i].used && s->runs[i].own_fd)
+      close(s->runs[i].fd);
+  }
+  if(s->signal_fd != -1) {
+    close(s->signal_fd);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+  }
+  close(s->epoll);
+  free(s->runs);
+}
+
+// ---------------------------------------------------------------------------
+static SupervisedRun* add_run(Supervisor* s, pid_t pid, double timeout, int tag) {
+  int i;
+  for(i = 0; i < s->size; i++) {
+    if(!s->runs[i].used) {
+      SupervisedRun* run = &s->runs[i];
+      memset(run, 0, sizeof(SupervisedRun));
+      run->used = 1;
+      run->tag = tag;
+      run->pid = pid;
+      run->fd = -1;
+      run->start = get_time();
+      run->deadline = timeout > 0 ? run->start + timeout : 0;
+      return run;
+    }
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+static int watch_fd(Supervisor* s, int fd, SupervisedRun* run) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = run;
+  return epoll_ctl(s->epoll, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// ---------------------------------------------------------------------------
+int supervisor_add_process(Supervisor* s, pid_t pid, double timeout, int tag) {
+  SupervisedRun* run = add_run(s, pid, timeout, tag);
+  if(!run)
+    return 0;
+
+  // a pidfd becomes readable once the process exited
+  int fd = syscall(SYS_pidfd_open, pid, 0);
+  if(fd != -1) {
+    run->fd = fd;
+    run->own_fd = 1;
+    if(watch_fd(s, fd, run))
+      return 1;
+    close(fd);
+    run->fd = -1;
+    run->own_fd = 0;
+  }
+
+  // older kernels, every SIGCHLD is checked against all processes
+  if(s->signal_fd == -1) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    s->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if(s->signal_fd == -1 || !watch_fd(s, s->signal_fd, NULL)) {
+      run->used = 0;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int supervisor_add_fd(Supervisor* s, int fd, pid_t pid, double timeout, int tag) {
+  SupervisedRun* run = add_run(s, pid, timeout, tag);
+  if(!run)
+    return 0;
+  run->fd = fd;
+  if(!watch_fd(s, fd, run)) {
+    run->used = 0;
+    return 0;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int supervisor_running(Supervisor* s) {
+  int i, running = 0;
+  for(i = 0; i < s->size; i++) {
+    running += s->runs[i].used;
+  }
+  return running;
+}
+
+// ---------------------------------------------------------------------------
+static void finish_run(Supervisor* s, SupervisedRun* run, int status, SupervisorEvent* event) {
+  event->tag = run->tag;
+  event->pid = run->pid;
+  event->fd = run->own_fd ? -1 : run->fd;
+  event->status = status;
+  event->timed_out = run->timed_out;
+  event->duration = get_time() - run->start;
+  if(run->fd != -1) {
+    epoll_ctl(s->epoll, EPOLL_CTL_DEL, run->fd, NULL);
+    if(run->own_fd)
+      close(run->fd);
+  }
+  run->used = 0;
+}
+
+// ---------------------------------------------------------------------------
+static int check_timeouts(Supervisor* s) {
+  // returns the time until the next deadline in ms, -1 if there is none
+  double now = get_time(), next = -1;
+  int i;
+  for(i = 0; i < s->size; i++) {
+    SupervisedRun* run = &s->runs[i];
+    if(!run->used || !run->deadline)
+      continue;
+    if(run->deadline <= now) {
+      // the whole process group, the target might have started children
+      run->timed_out = 1;
+      run->deadline = 0;
+      if(run->pid > 0) {
+        kill(-run->pid, SIGKILL);
+        kill(run->pid, SIGKILL);
+      }
+      continue;
+    }
+    if(next < 0 || run->deadline - now < next)
+      next = run->deadline - now;
+  }
+  return next < 0 ? -1 : (int) (next * 1000) + 1;
+}
+
+// ---------------------------------------------------------------------------
+int supervisor_wait(Supervisor* s, SupervisorEvent* event) {
+  int i;
+  while(supervisor_running(s)) {
+    struct epoll_event ev;
+    int n = epoll_wait(s->epoll, &ev, 1, check_timeouts(s));
+    if(n == -1 && errno != EINTR)
+      return 0;
+    if(n <= 0)
+      continue;
+
+    SupervisedRun* run = (SupervisedRun*) ev.data.ptr;
+    if(run) {
+      int status = 0;
+      // processes are reaped here, for other fds the caller reads the result
+      if(run->own_fd && waitpid(run->pid, &status, 0) == -1)
+        status = 0;
+      finish_run(s, run, status, event);
+      return 1;
+    }
+
+    // SIGCHLD without pidfd support
+    struct signalfd_siginfo info;
+    while(read(s->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+      // drain, several signals might be merged into one
+    }
+    for(i = 0; i < s->size; i++) {
+      run = &s->runs[i];
+      int status;
+      if(run->used && run->fd == -1 && waitpid(run->pid, &status, WNOHANG) == run->pid) {
+        finish_run(s, run, status, event);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+int wait_supervised(pid_t pid, double timeout, int* status) {
+  Supervisor s;
+  SupervisorEvent event;
+  if(!supervisor_init(&s, 1))
+    return waitpid(pid, status, 0) == pid ? 0 : -1;
+  if(!supervisor_add_process(&s, pid, timeout, 0) || !supervisor_wait(&s, &event)) {
+    supervisor_destroy(&s);
+    return waitpid(pid, status, 0) == pid ? 0 : -1;
+  }
+  supervisor_destroy(&s);
+  *status = event.status;
+  return event.timed_out;
+}
@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_SUPERVISOR_H_
+#define SRC_SUPERVISOR_H_
+
+#include <sys/types.h>
+
+// a running injection, finished once its process exited or its fd is readable
+typedef struct {
+  int used;
+  int tag;
+  pid_t pid;
+  int fd;
+  int own_fd;
+  double start;
+  double deadline;
+  int timed_out;
+} SupervisedRun;
+
+// result of a finished run
+typedef struct {
+  int tag;
+  pid_t pid;
+  int fd;
+  int status;
+  int timed_out;
+  double duration;
+} SupervisorEvent;
+
+typedef struct {
+  int epoll;
+  int signal_fd;
+  int size;
+  SupervisedRun* runs;
+} Supervisor;
+
+double get_time();
+int supervisor_init(Supervisor* s, int size);
+void supervisor_destroy(Supervisor* s);
+int supervisor_add_process(Supervisor* s, pid_t pid, double timeout, int tag);
+int supervisor_add_fd(Supervisor* s, int fd, pid_t pid, double timeout, int tag);
+int supervisor_running(Supervisor* s);
+int supervisor_wait(Supervisor* s, SupervisorEvent* event);
+int wait_supervised(pid_t pid, double timeout, int* status);
+
+#endif /* SRC_SUPERVISOR_H_ */
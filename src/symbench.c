@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "symbolizer.h"
+
+#define LOOKUPS 1000000
+#define ADDR2LINE_LOOKUPS 100
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int addr2line(const char* binary, uint64_t address, Symbol* s) {
+  char cmd[512], line[SYMBOL_LENGTH];
+  snprintf(cmd, sizeof(cmd), "addr2line -C -e %s -s -f -i %lx", binary, (unsigned long) address);
+  FILE* f = popen(cmd, "r");
+  if(!f)
+    return 0;
+  int ok = 0;
+  if(fgets(line, sizeof(line), f) && fgets(line, sizeof(line), f) && line[0] != '?' && !strstr(line, ":?")) {
+    char* p = strchr(line, ':');
+    if(p) {
+      *p = 0;
+      snprintf(s->file, SYMBOL_LENGTH, "%s", line);
+      s->line = atoi(p + 1);
+      ok = 1;
+    }
+  }
+  pclose(f);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  const char* binary = argc > 1 ? argv[1] : argv[0];
+  int i, lookups = argc > 2 ? atoi(argv[2]) : LOOKUPS;
+
+  SymbolIndex index;
+  double start = now();
+  if(!symbol_index_build(binary, &index) || !index.function_count) {
+    printf("No symbols in %s\n", binary);
+    return 1;
+  }
+  printf("index: %zu rows, %zu functions, built in %.1f ms\n", index.row_count, index.function_count,
+      (now() - start) / 1e6);
+
+  // addresses inside of random functions
+  uint64_t* addresses = malloc(lookups * sizeof(uint64_t));
+  if(!addresses)
+    return 1;
+  srand(1);
+  for(i = 0; i < lookups; i++) {
+    const FunctionSymbol* f = &index.functions[rand() % index.function_count];
+    addresses[i] = f->address + (f->size ? rand() % f->size : 0);
+  }
+
+  Symbol s;
+  int found = 0;
+  start = now();
+  for(i = 0; i < lookups; i++) {
+    found += symbol_index_lookup(&index, addresses[i], &s);
+  }
+  double native = (now() - start) / lookups;
+  printf("native: %.1f ns/lookup, %d of %d resolved\n", native, found, lookups);
+
+  // the old way, one addr2line process per address
+  int compared = lookups < ADDR2LINE_LOOKUPS ? lookups : ADDR2LINE_LOOKUPS, same = 0;
+  start = now();
+  for(i = 0; i < compared; i++) {
+    Symbol expected, actual;
+    int ok = addr2line(binary, addresses[i], &expected);
+    int native_ok = symbol_index_lookup(&index, addresses[i], &actual);
+    if(ok == native_ok && (!ok || (expected.line == actual.line && !strcmp(expected.file, actual.file))))
+      same++;
+  }
+  double external = (now() - start) / compared;
+  printf("addr2line: %.1f ns/lookup, %d of %d lookups agree\n", external, same, compared);
+  printf("speedup: %.0fx\n", external / native);
+
+  free(addresses);
+  symbol_index_destroy(&index);
+  return 0;
+}
@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "symbolizer.h"
+#include "map.h"
+
+// provided by the C++ runtime
+extern char* __cxa_demangle(const char* name, char* buffer, size_t* length, int* status);
+
+// index of the binary get_file_and_line was last called with
+static char symbol_binary[SYMBOL_LENGTH];
+static SymbolIndex symbols;
+static int symbols_loaded = 0;
+// resolved addresses, every frame is only looked up once
+static map_declare(symbol_cache) = NULL;
+
+// ---------------------------------------------------------------------------
+static int compare_functions(const void* a, const void* b) {
+  uint64_t fa = ((const FunctionSymbol*) a)->address, fb = ((const FunctionSymbol*) b)->address;
+  return fa < fb ? -1 : (fa > fb);
+}
+
+// ---------------------------------------------------------------------------
+static void read_functions(SymbolIndex* index) {
+  // the full symbol table if there is one, the dynamic one otherwise
+  ElfSection table, strings;
+  if(!elf_find_section(&index->elf, ".symtab", &table) && !elf_find_section(&index->elf, ".dynsym", &table))
+    return;
+  if(!elf_get_section(&index->elf, table.link, &strings) || table.type == SHT_NOBITS || strings.type == SHT_NOBITS)
+    return;
+
+  size_t entry_size = index->elf.is_64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+  size_t i, count = table.size / entry_size;
+  index->functions = malloc((count ? count : 1) * sizeof(FunctionSymbol));
+  if(!index->functions)
+    return;
+  const uint8_t* data = index->elf.data + table.offset;
+  for(i = 0; i < count; i++) {
+    FunctionSymbol f;
+    uint32_t name;
+    int type;
+    uint16_t section;
+    if(index->elf.is_64) {
+      const Elf64_Sym* s = (const Elf64_Sym*) data + i;
+      f.address = s->st_value;
+      f.size = s->st_size;
+      name = s->st_name;
+      type = ELF64_ST_TYPE(s->st_info);
+      section = s->st_shndx;
+    } else {
+      const Elf32_Sym* s = (const Elf32_Sym*) data + i;
+      f.address = s->st_value;
+      f.size = s->st_size;
+      name = s->st_name;
+      type = ELF32_ST_TYPE(s->st_info);
+      section = s->st_shndx;
+    }
+    if(type != STT_FUNC || section == SHN_UNDEF || name >= strings.size)
+      continue;
+    f.name = (const char*) index->elf.data + strings.offset + name;
+    if(!memchr(f.name, 0, strings.size - name))
+      continue;
+    index->functions[index->function_count++] = f;
+  }
+  qsort(index->functions, index->function_count, sizeof(FunctionSymbol), compare_functions);
+}
+
+// ---------------------------------------------------------------------------
+int symbol_index_build(const char* binary, SymbolIndex* index) {
+  memset(index, 0, sizeof(SymbolIndex));
+  if(!elf_open(binary, &index->elf))
+    return 0;
+  parse_line_table(&index->elf, &index->rows, &index->row_count);
+  read_functions(index);
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void symbol_index_destroy(SymbolIndex* index) {
+  free(index->rows);
+  free(index->functions);
+  elf_close(&index->elf);
+  memset(index, 0, sizeof(SymbolIndex));
+}
+
+// ---------------------------------------------------------------------------
+static void function_name(const char* name, char* function) {
+  // local clones like foo.part.0 are shown by the name of the function
+  char plain[SYMBOL_LENGTH];
+  snprintf(plain, SYMBOL_LENGTH, "%.*s", (int) strcspn(name, "."), name);
+  int status;
+  char* demangled = strncmp(plain, "_Z", 2) ? NULL : __cxa_demangle(plain, NULL, NULL, &status);
+  snprintf(function, SYMBOL_LENGTH, "%s", demangled ? demangled : plain);
+  free(demangled);
+}
+
+// ---------------------------------------------------------------------------
+int symbol_index_lookup(const SymbolIndex* index, uint64_t address, Symbol* symbol) {
+  strcpy(symbol->function, "??");
+  strcpy(symbol->file, "unknown");
+  symbol->line = 0;
+  symbol->ok = 0;
+
+  // last function starting before the address
+  size_t low = 0, high = index->function_count;
+  while(low < high) {
+    size_t mid = low + (high - low) / 2;
+    if(index->functions[mid].address <= address)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if(low) {
+    const FunctionSymbol* f = &index->functions[low - 1];
+    if(address < f->address + f->size || (!f->size && address == f->address))
+      function_name(f->name, symbol->function);
+  }
+
+  // last row before the address, unless its sequence ended there
+  low = 0;
+  high = index->row_count;
+  while(low < high) {
+    size_t mid = low + (high - low) / 2;
+    if(index->rows[mid].address <= address)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if(!low || index->rows[low - 1].end)
+    return 0;
+  const LineRow* row = &index->rows[low - 1];
+  snprintf(symbol->file, SYMBOL_LENGTH, "%s", row->file);
+  symbol->line = row->line;
+  symbol->ok = 1;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void release_symbols() {
+  if(symbols_loaded)
+    symbol_index_destroy(&symbols);
+  symbols_loaded = 0;
+  if(symbol_cache) {
+    cmap_iterator* it = map(symbol_cache)->iterator();
+    while(!map_iterator(it)->end()) {
+      free(map_iterator(it)->value());
+      map_iterator(it)->next();
+    }
+    map_iterator(it)->destroy();
+    map(symbol_cache)->destroy();
+    symbol_cache = NULL;
+  }
+}
+
+// ---------------------------------------------------------------------------
+int get_file_and_line(const char* binary, const void* addr, char *file, int *line, char* function) {
+  // the index is built once per binary
+  if(!symbols_loaded || strcmp(symbol_binary, binary)) {
+    release_symbols();
+    snprintf(symbol_binary, SYMBOL_LENGTH, "%s", binary);
+    symbols_loaded = symbol_index_build(binary, &symbols);
+    map_initialize(symbol_cache, MAP_GENERAL);
+  }
+  Symbol* s = (Symbol*) map(symbol_cache)->get(addr);
+  if(!s) {
+    s = malloc(sizeof(Symbol));
+    if(!s)
+      return 0;
+    symbol_index_lookup(&symbols, (uint64_t) (size_t) addr, s);
+    map(symbol_cache)->set(addr, s);
+  }
+  strcpy(function, s->function);
+  strcpy(file, s->file);
+  *line = s->line;
+  return s->ok;
+}
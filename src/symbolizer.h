@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SRC_SYMBOLIZER_H_
+#define SRC_SYMBOLIZER_H_
+
+#include <stdint.h>
+#include "elf_file.h"
+#include "dwarf.h"
+
+#define SYMBOL_LENGTH 256
+
+typedef struct {
+  int ok;
+  int line;
+  char function[SYMBOL_LENGTH];
+  char file[SYMBOL_LENGTH];
+} Symbol;
+
+typedef struct {
+  uint64_t address;
+  uint64_t size;
+  const char* name;
+} FunctionSymbol;
+
+// line table and function symbols of one binary, both sorted by address
+typedef struct {
+  ElfFile elf;
+  LineRow* rows;
+  size_t row_count;
+  FunctionSymbol* functions;
+  size_t function_count;
+} SymbolIndex;
+
+int symbol_index_build(const char* binary, SymbolIndex* index);
+void symbol_index_destroy(SymbolIndex* index);
+int symbol_index_lookup(const SymbolIndex* index, uint64_t address, Symbol* symbol);
+int get_file_and_line(const char* binary, const void* addr, char *file, int *line, char* function);
+void release_symbols();
+
+#endif /* SRC_SYMBOLIZER_H_ */
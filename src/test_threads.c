@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define THREADS 32
+#define ITERATIONS 10000
+
+void* worker(void* arg) {
+  int i;
+  for(i = 0; i < ITERATIONS; i++) {
+    char* a = malloc(32 + (i & 63));
+    if(a)
+      memset(a, 1, 32);
+    int* b = calloc(4, sizeof(int));
+    if(b)
+      b[0] = i;
+    char* c = realloc(a, 128);
+    if(c)
+      a = c;
+    free(a);
+    free(b);
+  }
+  return NULL;
+}
+
+int main() {
+  pthread_t threads[THREADS];
+  int i;
+  for(i = 0; i < THREADS; i++) {
+    if(pthread_create(&threads[i], NULL, worker, NULL)) {
+      printf("Could not create thread %d\n", i);
+      return 1;
+    }
+  }
+  for(i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  printf("%d threads done, expecting %d calls per site\n", THREADS, THREADS * ITERATIONS);
+  return 0;
+}
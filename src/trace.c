@@ -0,0 +1,245 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "symbolizer.h"
+#include "log.h"
+#include "trace.h"
+
+// ---------------------------------------------------------------------------
+static const uint8_t* get_varint(const uint8_t* pos, const uint8_t* end, uint64_t* value) {
+  int shift;
+  *value = 0;
+  for(shift = 0; pos < end && shift < 64; shift += 7) {
+    *value |= (uint64_t) (*pos & 0x7f) << shift;
+    if(!(*pos++ & 0x80))
+      return pos;
+  }
+  return NULL;
+}
+
+// ---------------------------------------------------------------------------
+static int read_sites(CallTrace* trace, const CallBlock* block) {
+  const uint8_t* pos = (const uint8_t*) (block + 1);
+  const uint8_t* end = pos + block->size;
+  uint32_t i;
+  for(i = 0; i < block->count; i++) {
+    uint64_t id, key, address, length;
+    if(!(pos = get_varint(pos, end, &id)) || !(pos = get_varint(pos, end, &key))
+        || !(pos = get_varint(pos, end, &address)) || !(pos = get_varint(pos, end, &length))
+        || id >= MAX_SITES || length > (uint64_t) (end - pos))
+      return 0;
+    TraceSite* site = &trace->sites[id];
+    site->known = 1;
+    site->key = key;
+    site->address = address;
+    snprintf(site->module, TRACE_MODULE_LENGTH, "%.*s", (int) length, (const char*) pos);
+    pos += length;
+    if(id >= trace->site_count)
+      trace->site_count = id + 1;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+int trace_open(const char* file, CallTrace* trace) {
+  memset(trace, 0, sizeof(CallTrace));
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) || st.st_size < (off_t) sizeof(CallTraceHeader)) {
+    if(fd != -1)
+      close(fd);
+    return 0;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return 0;
+  trace->data = data;
+  trace->size = st.st_size;
+
+  const CallTraceHeader* header = (const CallTraceHeader*) data;
+  trace->sites = (TraceSite*) calloc(MAX_SITES, sizeof(TraceSite));
+  trace->blocks = (const CallBlock**) malloc((trace->size / sizeof(CallBlock) + 1) * sizeof(CallBlock*));
+  if(header->magic != CALLS_MAGIC || header->version != CALLS_VERSION || !trace->sites || !trace->blocks) {
+    trace_close(trace);
+    return 0;
+  }
+
+  // the target may be killed while writing, a truncated last block is dropped
+  size_t offset = sizeof(CallTraceHeader);
+  while(offset + sizeof(CallBlock) <= trace->size) {
+    const CallBlock* block = (const CallBlock*) (trace->data + offset);
+    if(block->size > trace->size - offset - sizeof(CallBlock))
+      break;
+    if(block->type == CALL_BLOCK_SITES) {
+      if(!read_sites(trace, block)) {
+        trace_close(trace);
+        return 0;
+      }
+    } else if(block->type == CALL_BLOCK_EVENTS && block->count) {
+      if(!trace->block_count || block->start < trace->start)
+        trace->start = block->start;
+      trace->blocks[trace->block_count++] = block;
+    }
+    offset += sizeof(CallBlock) + block->size;
+  }
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+void trace_close(CallTrace* trace) {
+  if(trace->data)
+    munmap((void*) trace->data, trace->size);
+  free(trace->blocks);
+  free(trace->sites);
+  memset(trace, 0, sizeof(CallTrace));
+}
+
+// ---------------------------------------------------------------------------
+static int next_event(const CallTrace* trace, TraceCursor* cursor) {
+  // blocks of one thread are written in order, the next one continues
+  while(!cursor->left) {
+    if(cursor->pos) {
+      for(cursor->block++; cursor->block < trace->block_count; cursor->block++) {
+        if(trace->blocks[cursor->block]->thread == cursor->thread)
+          break;
+      }
+    }
+    if(cursor->block >= trace->block_count)
+      return 0;
+    const CallBlock* block = trace->blocks[cursor->block];
+    cursor->pos = (const uint8_t*) (block + 1);
+    cursor->end = cursor->pos + block->size;
+    cursor->left = block->count;
+    cursor->time = block->start;
+  }
+  uint64_t delta;
+  if(!(cursor->pos = get_varint(cursor->pos, cursor->end, &cursor->site))
+      || !(cursor->pos = get_varint(cursor->pos, cursor->end, &delta))
+      || !(cursor->pos = get_varint(cursor->pos, cursor->end, &cursor->size)) || cursor->site >= MAX_SITES) {
+    // a damaged block ends the events of its thread
+    cursor->block = trace->block_count;
+    return 0;
+  }
+  cursor->time += delta;
+  cursor->left--;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+static void describe_site(const char* binary, TraceSite* site) {
+  char file[256], fnc[256];
+  int line;
+  if(!site->known) {
+    snprintf(site->module, TRACE_MODULE_LENGTH, "?");
+    snprintf(site->position, TRACE_POSITION_LENGTH, "unknown site");
+  } else if(binary && get_file_and_line(binary, (void*) (size_t) site->address, file, &line, fnc)) {
+    snprintf(site->position, TRACE_POSITION_LENGTH, "%s in %s line %d", fnc, file, line);
+  } else {
+    snprintf(site->position, TRACE_POSITION_LENGTH, "%p", (void*) (size_t) site->address);
+  }
+}
+
+// ---------------------------------------------------------------------------
+static int compare_first_hit(const void* a, const void* b) {
+  const TraceSite* s1 = *(const TraceSite**) a;
+  const TraceSite* s2 = *(const TraceSite**) b;
+  return s1->first < s2->first ? -1 : s1->first > s2->first;
+}
+
+// ---------------------------------------------------------------------------
+int show_trace(const char* file, const char* binary) {
+  CallTrace trace;
+  if(!trace_open(file, &trace)) {
+    log("{red}Could not read call trace '%s'!{/red}", file);
+    return 0;
+  }
+
+  // one cursor per thread, starting at its first block
+  TraceCursor* cursors = (TraceCursor*) calloc(trace.block_count + 1, sizeof(TraceCursor));
+  size_t i, threads = 0, events = 0;
+  for(i = 0; i < trace.block_count; i++) {
+    size_t j;
+    for(j = 0; j < threads && cursors[j].thread != trace.blocks[i]->thread; j++)
+      ;
+    if(j == threads) {
+      cursors[threads].thread = trace.blocks[i]->thread;
+      cursors[threads].block = i;
+      if(next_event(&trace, &cursors[threads]))
+        threads++;
+    }
+  }
+  for(i = 0; i < trace.site_count; i++) {
+    describe_site(binary, &trace.sites[i]);
+  }
+
+  // merge the threads by time
+  log("Call trace %s, %zd thread(s)\n", file, threads);
+  while(threads) {
+    size_t min = 0;
+    for(i = 1; i < threads; i++) {
+      if(cursors[i].time < cursors[min].time)
+        min = i;
+    }
+    TraceCursor* c = &cursors[min];
+    TraceSite* site = &trace.sites[c->site];
+    if(!site->calls++)
+      site->first = c->time;
+    site->bytes += c->size;
+    if(c->site >= trace.site_count) {
+      trace.site_count = c->site + 1;
+      describe_site(binary, site);
+    }
+    log("%12.3f us  [%5u]  #%-5llu [{yellow}%s{/yellow}] {cyan}%s{/cyan}: %llu bytes", (c->time - trace.start) / 1000.0,
+        c->thread, (unsigned long long) c->site, site->module, site->position, (unsigned long long) c->size);
+    events++;
+    if(!next_event(&trace, c))
+      cursors[min] = cursors[--threads];
+  }
+  free(cursors);
+
+  // sites in the order they were first hit
+  TraceSite** hit = (TraceSite**) malloc((trace.site_count + 1) * sizeof(TraceSite*));
+  size_t count = 0;
+  for(i = 0; i < trace.site_count; i++) {
+    if(trace.sites[i].calls)
+      hit[count++] = &trace.sites[i];
+  }
+  qsort(hit, count, sizeof(TraceSite*), compare_first_hit);
+  log("\n{green}%zd call(s) at %zd site(s){/green}", events, count);
+  for(i = 0; i < count; i++) {
+    log(" >  #%-5zd [{yellow}%s{/yellow}] {cyan}%s{/cyan}: first hit at %.3f us, %zd calls, %llu bytes",
+        (size_t) (hit[i] - trace.sites), hit[i]->module, hit[i]->position, (hit[i]->first - trace.start) / 1000.0,
+        hit[i]->calls, (unsigned long long) hit[i]->bytes);
+  }
+  free(hit);
+  trace_close(&trace);
+  return 1;
+}
@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    faint - a FAult INjection Tester
+//    Copyright (C) 2016  Michael Schwarz
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//    E-Mail: michael.schwarz91@gmail.com
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "settings.h"
+
+#define TRACE_POSITION_LENGTH 600
+#define TRACE_MODULE_LENGTH 32
+
+// site of the call trace, with the statistics of its events
+typedef struct {
+  int known;
+  uint64_t key;
+  uint64_t address;
+  char module[TRACE_MODULE_LENGTH];
+  char position[TRACE_POSITION_LENGTH];
+  uint64_t first;
+  size_t calls;
+  uint64_t bytes;
+} TraceSite;
+
+// a call trace mapped read-only, blocks point into the file
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  const CallBlock** blocks;
+  size_t block_count;
+  TraceSite* sites;
+  size_t site_count;
+  uint64_t start;
+} CallTrace;
+
+// events of one thread, read block after block
+typedef struct {
+  uint32_t thread;
+  size_t block;
+  const uint8_t* pos;
+  const uint8_t* end;
+  uint32_t left;
+  uint64_t time;
+  uint64_t site;
+  uint64_t size;
+} TraceCursor;
+
+int trace_open(const char* file, CallTrace* trace);
+void trace_close(CallTrace* trace);
+int show_trace(const char* file, const char* binary);
+
+#endif /* SRC_TRACE_H_ */
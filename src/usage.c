@@ -73,6 +73,18 @@ Usage* generate_usage() {
   add_entry(u, "--profile-only", "Only to the profile step, no fault injection", 1);
   add_entry(u, "--inject-only", "Only to the injectino step, no profiling", 1);
   add_entry(u, "--trace-heap", "Trace heap allocations and memory leaks", 1);
+  add_entry_param(u, "--trace-calls", "Write every intercepted call of the profiling run in order to this file", 1, "filename", 0);
+  add_entry_param(u, "--show-trace", "Print a call trace, the binary after it is used for line numbers", 1, "filename", 0);
+  add_entry_param(u, "--jobs", "Number of injection runs executed in parallel (default: number of CPUs)", 1, "count", 0);
+  add_entry(u, "--keep-aslr", "Do not disable address space layout randomization for the target", 1);
+  add_entry(u, "--fork-server", "Fork injection runs from a target stopped at main instead of starting it again", 1);
+  add_entry(u, "--explore", "Fork an injection run at the first call of every site within a single execution", 1);
+  add_entry_param(u, "--timeout", "Kill injection runs after this many seconds (default: 10x profiling time + 1s, 0: never)", 1, "seconds", 0);
+  add_entry_param(u, "--stack-depth", "Distinguish injection sites by up to this many calling frames", 1, "depth", 0);
+  add_entry_param(u, "--bucket-depth", "Group crashes in the summary by up to this many innermost frames (default: 1)", 1, "depth", 0);
+  add_entry(u, "--no-cache", "Neither use nor store results of earlier runs", 1);
+  add_entry(u, "--refresh", "Discard cached results of earlier runs and store new ones", 1);
+  add_entry_param(u, "--cache-dir", "Store cached results here (default: $FAINT_CACHE_DIR, $XDG_CACHE_HOME/faint or ~/.cache/faint)", 1, "directory", 0);
   add_entry(u, "--version", "Show program version", 1);
   return u;
 }
@@ -35,7 +35,9 @@
 #define personality(pers) ((long)syscall(SYS_personality, pers))
 #endif
 
+#include <elf.h>
 #include "utils.h"
+#include "elf_file.h"
 #include "log.h"
 
 // ---------------------------------------------------------------------------
@@ -81,122 +83,26 @@ void str_replace_inplace(char** orig, const char* rep, const char* with) {
 }
 
 
-// ---------------------------------------------------------------------------
-int get_file_and_line(const char* binary, const void* addr, char *file, int *line, char* function) {
-  static char buf[256];
-
-  // call addr2line
-  sprintf(buf, "addr2line -C -e %s -s -f -i %lx", binary, (size_t) addr);
-  FILE* f = popen(buf, "r");
-
-  if(f == NULL) {
-    log("{red}Could not resolve address %p, do you have addr2line installed?{/red}\n", addr);
-    return 0;
-  }
-
-  // get function name
-  if(!fgets(buf, 256, f)) {
-    pclose(f);
-    return 0;
-  }
-  strcpy(function, buf);
-  int i;
-  for(i = 0; i < strlen(function); i++) {
-    if(function[i] == '\n' || function[i] == '\r') {
-      function[i] = 0;
-      break;
-    }
-  }
-
-  // get file and line
-  if(!fgets(buf, 256, f)) {
-    pclose(f);
-    return 0;
-  }
-
-  if(buf[0] != '?') {
-    char *p = buf;
-
-    // file name is until ':'
-    while(*p != ':') {
-      p++;
-      if((p - buf) >= 256) {
-        pclose(f);
-        return 0;
-      }
-    }
-
-    *p++ = 0;
-    // after file name follows line number
-    strcpy(file, buf);
-    sscanf(p, "%d", line);
-  } else {
-    strcpy(file, "unknown");
-    *line = 0;
-    pclose(f);
-    return 0;
-  }
-
-  pclose(f);
-  return 1;
-}
-
 // ---------------------------------------------------------------------------
 void check_debug_symbols(const char* binary) {
-  char re_cmdline[256];
-  sprintf(re_cmdline, "readelf --debug-dump=line \"%s\" | wc -l", binary);
-  FILE* dbg = popen(re_cmdline, "r");
-  if(dbg) {
-    char debug_lines[32];
-    if(!fgets(debug_lines, 32, dbg)) {
-      pclose(dbg);
-      return;
-    }
-    if(atoi(debug_lines) == 0) {
-      log("{red}Could not find debugging info! Did you compile with -g?{/red}\n");
-    }
-    pclose(dbg);
+  // only the section table is read, not the debug info itself
+  ElfFile elf;
+  ElfSection lines;
+  if(!elf_open(binary, &elf))
+    return;
+  if(!elf_find_section(&elf, ".debug_line", &lines) || lines.type == SHT_NOBITS || !lines.size) {
+    log("{red}Could not find debugging info! Did you compile with -g?{/red}\n");
   }
-}
-
-// ---------------------------------------------------------------------------
-size_t get_base_address() {
-    size_t base = 0;
-    char cmd[256];
-    sprintf(cmd, "cat /proc/%d/maps | grep 'r-xp' | head -1 | sed 's/-/ /'", getpid());
-    FILE* addr = popen(cmd, "r");
-    if(addr) {
-        char line[256];
-        if(!fgets(line, 256, addr)) {
-            pclose(addr);
-            return 0;
-        }
-        if((base = strtoull(line, NULL, 16)) == 0) {
-            log("{red}Could not find base address!{/red}\n");
-        }
-        pclose(addr);
-    }
-    return base;
+  elf_close(&elf);
 }
 
 // ---------------------------------------------------------------------------
 int get_architecture(const char* binary) {
-  int arch = ARCH_64;
-  char obj_cmdline[256];
-  sprintf(obj_cmdline, "objdump -f \"%s\" | grep elf", binary);
-  FILE* dbg = popen(obj_cmdline, "r");
-  if(dbg) {
-    char debug_lines[256];
-    if(!fgets(debug_lines, 256, dbg)) {
-      pclose(dbg);
-      return arch;
-    }
-    if(strstr(debug_lines, "elf32") != NULL)
-      arch = ARCH_32;
-    if(strstr(debug_lines, "elf64") != NULL)
-      arch = ARCH_64;
-    pclose(dbg);
-  }
+  ElfFile elf;
+  if(!elf_open(binary, &elf))
+    return ARCH_64;
+  int arch = elf.is_64 ? ARCH_64 : ARCH_32;
+  elf_close(&elf);
   return arch;
 }
 
@@ -222,16 +128,5 @@ void show_return_details(int status) {
   }
 }
 
-// ---------------------------------------------------------------------------
-int wait_for_child(pid_t pid) {
-  int status, killed = 0;
-  waitpid(pid, &status, 0);
-
-  show_return_details(status);
-  if(WIFSIGNALED(status)) {
-    killed = 1;
-  }
-  return killed;
-}
 
 
@@ -29,11 +29,9 @@
 
 char* str_replace(const char* orig, const char* rep, const char* with);
 void str_replace_inplace(char** orig, const char* rep, const char* with);
-int get_file_and_line(const char* binary, const void* addr, char *file, int *line, char* function);
 void check_debug_symbols(const char* binary);
 int get_architecture(const char* binary);
 void disable_aslr();
 void show_return_details(int status);
-int wait_for_child(pid_t pid);
 
 #endif /* SRC_UTILS_H_ */